@@ -28,3 +28,24 @@ project "PyExpand"
 
 	filter "configurations:Release"
 		optimize "On"
+
+filter {}
+
+project "PyExpandTests"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++20"
+	targetdir ".build"
+	dependson "PyExpand" -- The large file test runs PyExpand.exe
+	
+	specify_warnings()
+	
+	includedirs "."
+	files { "tests/**", "src/ds/**", "src/win32_utils.h", "src/win32_utils.cpp", "src/line_index.h", "src/line_index.cpp",
+		"src/block_parser.h", "src/block_parser.cpp" }
+	
+	filter "configurations:Debug"
+		symbols "On"
+
+	filter "configurations:Release"
+		optimize "On"
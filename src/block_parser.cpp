@@ -0,0 +1,219 @@
+#include "ds/ds.h"
+
+#include "line_index.h"
+#include "block_parser.h"
+
+// Comment syntaxes that blocks can be written in. A block is written as `Open <python code> Close`, and its result is written after it,
+// up to the next `Terminator`, which starts the comment that ends the expansion (e.g. `/**/`). If `ResultsOnOwnLines` is set, the results
+// of single-line blocks are written on their own lines too, like those of multi-line blocks.
+struct CSyntax // C, C++, C#, shaders, SQL, ...
+{
+	static constexpr char Open[] = "/*.py";
+	static constexpr char Close[] = "*/";
+	static constexpr char Terminator[] = "/*";
+	static constexpr bool ResultsOnOwnLines = false;
+};
+
+struct CMakeSyntax // Bracket comments, i.e. `#[[.py ... ]]` and `#[[]]`
+{
+	static constexpr char Open[] = "#[[.py";
+	static constexpr char Close[] = "]]";
+	static constexpr char Terminator[] = "#[[";
+	static constexpr bool ResultsOnOwnLines = false;
+};
+
+struct LuaSyntax // Long comments, i.e. `--[[.py ... ]]` and `--[[]]`
+{
+	static constexpr char Open[] = "--[[.py";
+	static constexpr char Close[] = "]]";
+	static constexpr char Terminator[] = "--[[";
+	static constexpr bool ResultsOnOwnLines = false;
+};
+
+// Python has no block comments, so blocks are unused string literals, i.e. `'''.py ... '''`, and the expansion ends with the line comment
+// `#.end`, which can't be confused with the end of a block. A result next to a string literal isn't valid python, so results are
+// always written on their own lines.
+struct PythonSyntax
+{
+	static constexpr char Open[] = "'''.py";
+	static constexpr char Close[] = "'''";
+	static constexpr char Terminator[] = "#.end";
+	static constexpr bool ResultsOnOwnLines = true;
+};
+
+static bool IsIdentifierChar(char c)
+{
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+// Finds the earlier named blocks whose names the code of each block uses. Any matching identifier counts, even in a string or
+// a comment, which at worst makes the block wait for a value that it doesn't need, or get the error of a named block that failed.
+// If several blocks have the same name, the closest one before the block is used.
+static void FindBlockDependencies(DS_Arena* arena, DS_Slice<PythonBlock> blocks)
+{
+	DS_Array<intptr_t> named_blocks(arena);
+	for (intptr_t i = 0; i < blocks.Size; i++)
+	{
+		DS_Array<intptr_t> dependencies(arena);
+		DS_StringView source = blocks[i].Source;
+		for (intptr_t j = 0; j < source.Size && named_blocks.Size > 0;)
+		{
+			if (!IsIdentifierChar(source.Data[j]))
+			{
+				j++;
+				continue;
+			}
+
+			intptr_t identifier_start = j;
+			while (j < source.Size && IsIdentifierChar(source.Data[j]))
+				j++;
+			DS_StringView identifier = source.Slice(identifier_start, j);
+
+			for (intptr_t k = named_blocks.Size - 1; k >= 0; k--)
+			{
+				if (blocks[named_blocks[k]].Name != identifier)
+					continue;
+
+				bool already_added = false;
+				for (intptr_t l = 0; l < dependencies.Size; l++)
+					already_added = already_added || dependencies[l] == named_blocks[k];
+				if (!already_added)
+					dependencies.Add(named_blocks[k]);
+				break;
+			}
+		}
+
+		blocks[i].Dependencies = dependencies;
+		if (blocks[i].Name.Size > 0)
+			named_blocks.Add(i);
+	}
+}
+
+// Parses `file_data` for blocks in the comment syntax `Syntax`, e.g. `/*.py ... */` for CSyntax. The text to keep around the
+// blocks is added to `out_ranges_to_keep`, which ends up with one more range than there are blocks.
+template<typename Syntax>
+static void ParseFileData(DS_Arena* arena, DS_StringView file_data, DS_Array<DS_StringView>* out_ranges_to_keep, DS_Array<PythonBlock>* out_blocks)
+{
+	constexpr intptr_t open_size = sizeof(Syntax::Open) - 1;
+	constexpr intptr_t close_size = sizeof(Syntax::Close) - 1;
+
+	DS_StringView remaining = file_data;
+	for (;;)
+	{
+		intptr_t pyexpand_offset = FindMarker(remaining, 0, Syntax::Open);
+		if (pyexpand_offset == remaining.Size)
+			break;
+		intptr_t block_offset = (remaining.Data - file_data.Data) + pyexpand_offset;
+
+		// A name directly follows the opening marker, e.g. `/*.py:opcodes`
+		intptr_t code_offset = pyexpand_offset + open_size;
+		DS_StringView name;
+		if (code_offset < remaining.Size && remaining.Data[code_offset] == ':')
+		{
+			intptr_t name_end = code_offset + 1;
+			while (name_end < remaining.Size && IsIdentifierChar(remaining.Data[name_end]))
+				name_end++;
+			name = remaining.Slice(code_offset + 1, name_end);
+			bool is_valid_name = name.Size > 0 && !(name.Data[0] >= '0' && name.Data[0] <= '9');
+			if (is_valid_name)
+				code_offset = name_end;
+			else
+				name = DS_StringView();
+		}
+
+		intptr_t end_comment_offset = FindMarker(remaining, code_offset, Syntax::Close);
+		DS_StringView python_string = remaining.Slice(code_offset, end_comment_offset);
+		out_ranges_to_keep->Add(remaining.Slice(0, end_comment_offset + close_size));
+
+		intptr_t terminator_comment_offset = FindMarker(remaining, end_comment_offset + close_size, Syntax::Terminator);
+		remaining = remaining.Slice(terminator_comment_offset);
+
+		DS_DynamicString new_python_string(arena);
+
+		bool is_multiline = python_string.Find("return") != python_string.Size;
+		if (is_multiline)
+		{
+			new_python_string.Add("def user_fn():\n");
+			ReindentLines(python_string, "\t", "\n", ReindentFlags_SkipEmptyLines | ReindentFlags_OnlyUnindentedLines | ReindentFlags_TerminateLastLine, &new_python_string);
+			new_python_string.Add(name.Size > 0 ? DS_StringView("user_value = user_fn()\n") : DS_StringView("print(user_fn())\n"));
+		}
+		else
+		{
+			DS_StringView lines = python_string;
+			int lines_count = 0;
+			while (lines.Size > 0)
+			{
+				DS_StringView line = lines.Split("\n");
+				lines_count += 1;
+			}
+			if (lines_count <= 1)
+			{
+				new_python_string.Add(name.Size > 0 ? DS_StringView("user_value = (") : DS_StringView("print("));
+				new_python_string.Add(python_string);
+				new_python_string.Add(")\n");
+			}
+			else
+			{
+				new_python_string.Add("print('Error: No return statement found in a multiline code block!')");
+				name = DS_StringView();
+			}
+		}
+
+		if (name.Size > 0)
+		{
+			new_python_string.Add("print(user_value)\n");
+			new_python_string.Add("import pickle, base64\n");
+			new_python_string.Add("print('\\x00pyexpand-value:' + base64.b64encode(pickle.dumps(user_value)).decode())\n");
+		}
+
+		PythonBlock block = {};
+		block.Source = python_string;
+		block.Offset = block_offset;
+		block.Code = new_python_string;
+		block.IsMultiline = is_multiline || Syntax::ResultsOnOwnLines;
+		block.Name = name;
+		out_blocks->Add(block);
+	}
+	out_ranges_to_keep->Add(remaining);
+
+	FindBlockDependencies(arena, *out_blocks);
+}
+
+ParseFileDataFn* GetFileParser(const char* filepath)
+{
+	DS_StringView name = DS_Str(filepath);
+	for (intptr_t i = name.Size - 1; i >= 0; i--)
+	{
+		if (name.Data[i] == '/' || name.Data[i] == '\\')
+		{
+			name = name.Slice(i + 1);
+			break;
+		}
+	}
+
+	char lowercase_name[64];
+	if (name.Size >= (intptr_t)sizeof(lowercase_name))
+		return ParseFileData<CSyntax>;
+	for (intptr_t i = 0; i < name.Size; i++)
+		lowercase_name[i] = name.Data[i] >= 'A' && name.Data[i] <= 'Z' ? name.Data[i] - 'A' + 'a' : name.Data[i];
+
+	DS_StringView lowercase = DS_StringView(lowercase_name, name.Size);
+	if (lowercase == "cmakelists.txt")
+		return ParseFileData<CMakeSyntax>;
+
+	intptr_t dot = lowercase.RFindChar('.');
+	DS_StringView extension = dot == lowercase.Size ? DS_StringView() : lowercase.Slice(dot + 1);
+
+	// The case labels are hashed at compile time. The extension is still compared, since different strings can have the same hash.
+	ParseFileDataFn* parser = ParseFileData<CSyntax>;
+	DS_StringView parser_extension;
+	switch (DS_HashString(extension))
+	{
+	case DS_HashString("cmake"): parser = ParseFileData<CMakeSyntax>; parser_extension = "cmake"; break;
+	case DS_HashString("lua"):   parser = ParseFileData<LuaSyntax>; parser_extension = "lua"; break;
+	case DS_HashString("py"):    parser = ParseFileData<PythonSyntax>; parser_extension = "py"; break;
+	case DS_HashString("pyw"):   parser = ParseFileData<PythonSyntax>; parser_extension = "pyw"; break;
+	default: break;
+	}
+	return extension == parser_extension ? parser : ParseFileData<CSyntax>;
+}
@@ -0,0 +1,61 @@
+// Parsing of the python blocks in a file.
+//
+// A block is written in a block comment of the file's language, e.g. `/*.py <python code> */` in C, and its result is written after
+// it, up to an end marker, e.g. `/**/`. The comment syntax is chosen by the file extension.
+
+#include <emmintrin.h> // SSE2, for FindMarker
+
+struct PythonBlock
+{
+	DS_StringView Source; // The text between the opening and closing markers, e.g. `/*.py` and `*/`
+	intptr_t Offset;      // Offset of the opening marker in the file
+	DS_String Code;       // The python code to evaluate, which prints the result
+	bool IsMultiline;     // The result is written on its own lines
+	DS_StringView Name;   // Name of a named block, e.g. `opcodes` for `/*.py:opcodes`. Later blocks can use its return value by this name.
+	DS_Slice<intptr_t> Dependencies; // Indices of the earlier named blocks whose values the code uses
+};
+
+// Named blocks print their pickled return value after the result, following this marker, so that it can be passed to later blocks
+static const DS_StringView BLOCK_VALUE_MARKER = "\0pyexpand-value:";
+
+// Returns the offset of the first `marker` in `text` at or after `start_from`, or text.Size if there is none. Since the marker
+// is known at compile time, 16 positions at a time are checked for its first and last characters with SSE2, and only those
+// candidates are compared fully.
+template<size_t N>
+static inline intptr_t FindMarker(DS_StringView text, intptr_t start_from, const char (&marker)[N])
+{
+	constexpr intptr_t marker_size = N - 1;
+	static_assert(marker_size >= 2, "Markers must be at least 2 characters long");
+
+	const __m128i first = _mm_set1_epi8(marker[0]);
+	const __m128i last = _mm_set1_epi8(marker[marker_size - 1]);
+
+	intptr_t i = start_from;
+	for (; i + marker_size - 1 + 16 <= text.Size; i += 16)
+	{
+		__m128i first_chunk = _mm_loadu_si128((const __m128i*)(text.Data + i));
+		__m128i last_chunk = _mm_loadu_si128((const __m128i*)(text.Data + i + marker_size - 1));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first_chunk, first), _mm_cmpeq_epi8(last_chunk, last)));
+		while (mask)
+		{
+			int bit = std::countr_zero(mask);
+			if (memcmp(text.Data + i + bit + 1, marker + 1, marker_size - 2) == 0)
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	for (; i + marker_size <= text.Size; i++)
+	{
+		if (memcmp(text.Data + i, marker, marker_size) == 0)
+			return i;
+	}
+	return text.Size;
+}
+
+// Parses `file_data` for blocks. The text to keep around the blocks is added to `out_ranges_to_keep`, which ends up with one more range
+// than there are blocks. The code of the blocks and their dependencies are allocated from `arena`.
+typedef void ParseFileDataFn(DS_Arena* arena, DS_StringView file_data, DS_Array<DS_StringView>* out_ranges_to_keep, DS_Array<PythonBlock>* out_blocks);
+
+// Picks the comment syntax of a file by its extension. Files with unknown extensions use the C syntax.
+ParseFileDataFn* GetFileParser(const char* filepath);
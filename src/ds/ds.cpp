@@ -67,91 +67,6 @@ intptr_t DS_StringView::CodepointCount() {
 	return DS_CodepointCount(Data, Size);
 }
 
-intptr_t DS_StringView::Find(DS_StringView other, intptr_t start_from)
-{
-	DS_ASSERT(start_from >= 0 && start_from <= Size);
-	intptr_t result = Size;
-	if (other.Size <= Size)
-	{
-		char* ptr = Data + start_from;
-		char* end = Data + Size - other.Size;
-		for (; ptr <= end; ptr++)
-		{
-			if (memcmp(ptr, other.Data, other.Size) == 0) {
-				result = ptr - Data;
-				break;
-			}
-		}
-	}
-	return result;
-}
-
-intptr_t DS_StringView::RFind(DS_StringView other, intptr_t start_from)
-{
-	intptr_t result = Size;
-	if (other.Size <= Size)
-	{
-		char* ptr = Data + (start_from >= Size ? Size : start_from) - other.Size;
-		for (; ptr >= Data; ptr--)
-		{
-			if (memcmp(ptr, other.Data, other.Size) == 0) {
-				result = ptr - Data;
-				break;
-			}
-		}
-	}
-	return result;
-}
-
-intptr_t DS_StringView::FindChar(char other, intptr_t start_from)
-{
-	DS_ASSERT(start_from >= 0 && start_from <= Size);
-	intptr_t result = Size;
-	char* ptr = Data + start_from;
-	char* end = Data + Size;
-	for (; ptr < end; ptr++)
-	{
-		if (*ptr == other) {
-			result = ptr - Data;
-			break;
-		}
-	}
-	return result;
-}
-
-intptr_t DS_StringView::RFindChar(char other, intptr_t start_from)
-{
-	intptr_t result = Size;
-	char* ptr = Data + (start_from >= Size ? Size : start_from) - 1;
-	for (; ptr >= Data; ptr--)
-	{
-		if (*ptr == other) {
-			result = ptr - Data;
-			break;
-		}
-	}
-	return result;
-}
-
-DS_StringView DS_StringView::Split(DS_StringView split_by)
-{
-	intptr_t offset = Find(split_by);
-	DS_StringView result = {Data, offset};
-	intptr_t advance = offset + split_by.Size > Size ? Size : offset + split_by.Size;
-	Data += advance;
-	Size -= advance;
-	return result;
-}
-
-DS_StringView DS_StringView::Slice(intptr_t from, intptr_t to)
-{
-	if (to == INTPTR_MAX) to = Size;
-	DS_ASSERT(from >= 0);
-	DS_ASSERT(to <= Size);
-	DS_ASSERT(to >= from);
-	return DS_StringView(Data + from, to - from);
-}
-
 DS_String DS_StringView::Clone(DS_Arena* arena) const {
 	DS_String result;
 	result.Data = arena->PushUninitialized(Size + 1);
@@ -165,6 +80,34 @@ char* DS_StringView::ToCStr(DS_Arena* arena) const {
 	return Clone(arena).CStr();
 }
 
+uint64_t DS_Hash64(const void* data, size_t size, uint64_t seed)
+{
+	const uint64_t k = 0x9E3779B97F4A7C15;
+	const char* ptr = (const char*)data;
+	uint64_t hash = seed ^ (size * k);
+
+	// Mixing in one 64-bit word at a time
+	for (; size >= 8; ptr += 8, size -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, ptr, 8);
+		hash = (hash ^ word) * k;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, ptr, size);
+	hash = (hash ^ tail) * k;
+
+	// Final avalanche (from MurmurHash3's fmix64)
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCD;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53;
+	hash ^= hash >> 33;
+	return hash;
+}
+
 void DS_Arena::Init(DS_Allocator* backing_allocator, void* initial_block, uint32_t block_size, uint32_t block_alignment)
 {
 	BackingAllocator = backing_allocator ? backing_allocator : DS_HeapAllocator();
@@ -217,7 +160,7 @@ char* DS_Arena::PushUninitialized(size_t size, size_t alignment)
 	void* curr_ptr = Mark.Ptr;
 
 	char* result = (char*)DS_AlignUpPow2((intptr_t)curr_ptr, alignment);
-	intptr_t remaining_space = curr_block ? curr_block->SizeIncludingHeader - ((intptr_t)result - (intptr_t)curr_block) : 0;
+	intptr_t remaining_space = curr_block ? (intptr_t)curr_block->SizeIncludingHeader - ((intptr_t)result - (intptr_t)curr_block) : 0;
 
 	if ((intptr_t)size > remaining_space)
 	{
@@ -234,7 +177,7 @@ char* DS_Arena::PushUninitialized(size_t size, size_t alignment)
 		{
 			next_block = curr_block->Next;
 
-			intptr_t next_block_remaining_space = next_block->SizeIncludingHeader - result_offset;
+			intptr_t next_block_remaining_space = (intptr_t)next_block->SizeIncludingHeader - result_offset;
 			if ((intptr_t)size <= next_block_remaining_space) {
 				new_block = next_block; // Next block has enough space, let's use it!
 			}
@@ -247,7 +190,7 @@ char* DS_Arena::PushUninitialized(size_t size, size_t alignment)
 			DS_ASSERT(((uintptr_t)new_block & ((uintptr_t)BlockAlignment - 1)) == 0); // make sure that the alignment is correct
 
 			new_block->AllocatedFromBackingAllocator = true;
-			new_block->SizeIncludingHeader = (uint32_t)new_block_size;
+			new_block->SizeIncludingHeader = (size_t)new_block_size;
 			new_block->Next = next_block;
 #ifdef DS_ARENA_MEMORY_TRACKING
 			total_mem_reserved += new_block_size;
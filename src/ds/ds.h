@@ -3,8 +3,13 @@
 //
 // - Dynamic array
 // - Hash map, set
+// - Concurrent read-mostly hash map
+// - Bit set
+// - Relocatable binary images of arrays and maps
+// - Sorting: introsort, LSD radix sort, parallel merge sort
 // - Allocator API, arena allocator
 // - String, string view
+// - Lock-free queues: single-producer single-consumer ring buffer, bounded multi-producer multi-consumer queue
 // 
 // This code is released under the MIT license (https://opensource.org/licenses/MIT).
 
@@ -14,6 +19,22 @@
 #include <string.h>  // memcpy, memmove, memset, memcmp, strlen
 #include <stdarg.h>  // va_list
 #include <type_traits>
+#include <atomic>
+#include <new>       // placement new
+#include <bit>       // std::popcount, std::countr_zero
+#include <thread>    // std::thread, for DS_ParallelSort
+#include <mutex>     // std::mutex, for DS_ConcurrentMap
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define DS_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef DS_HAS_SSE2
+#define DS_Prefetch(PTR) _mm_prefetch((const char*)(PTR), _MM_HINT_T0)
+#else
+#define DS_Prefetch(PTR) ((void)0)
+#endif
 
 #ifndef DS_NO_PRINTF
 #include <stdio.h>
@@ -24,6 +45,8 @@
 #define DS_ASSERT(X) assert(X)
 #endif
 
+#define DS_CACHE_LINE_SIZE 64
+
 struct DS_Allocator
 {
 	// A new allocation is made when new_size > 0.
@@ -67,7 +90,7 @@ static DS_Allocator* DS_HeapAllocator() {
 
 struct DS_ArenaBlockHeader
 {
-	uint32_t SizeIncludingHeader;
+	size_t SizeIncludingHeader;
 	bool AllocatedFromBackingAllocator;
 	DS_ArenaBlockHeader* Next; // may be NULL
 };
@@ -151,36 +174,36 @@ template<typename T>
 struct DS_Array
 {
 	T* Data;
-	int32_t Size;
-	int32_t Capacity;
+	intptr_t Size;
+	intptr_t Capacity;
 	DS_Allocator* Allocator;
 
 	// ------------------------------------------------------------------------
 
 	// If the arena is NULL, the stored allocator is set to NULL and you must call Init() before use
-	inline DS_Array<T>(DS_Arena* arena = NULL, int32_t initial_capacity = 0);
+	inline DS_Array<T>(DS_Arena* arena = NULL, intptr_t initial_capacity = 0);
 
 	// If allocator is NULL, the heap allocator is used.
-	inline void Init(DS_Allocator* allocator = NULL, int32_t initial_capacity = 0);
+	inline void Init(DS_Allocator* allocator = NULL, intptr_t initial_capacity = 0);
 
 	inline void Deinit();
 	
 	// Clear does not free memory. We could have "Clear" and "ClearNoRealloc"
 	inline void Clear();
 	
-	inline void Reserve(int32_t reserve_count);
+	inline void Reserve(intptr_t reserve_count);
 	
-	inline void Resize(int32_t new_count, const T& default_value);
+	inline void Resize(intptr_t new_count, const T& default_value);
 
 	inline void Add(const T& value);
 
 	inline void AddSlice(DS_Slice<T> values);
 	
-	inline void Insert(int32_t at, const T& value, int n = 1);
+	inline void Insert(intptr_t at, const T& value, intptr_t n = 1);
 
-	inline T& Remove(int32_t index, int n = 1);
+	inline void Remove(intptr_t index, intptr_t n = 1);
 	
-	inline T& PopBack(int n = 1);
+	inline T& PopBack(intptr_t n = 1);
 	
 	inline void ReverseOrder();
 	
@@ -252,22 +275,24 @@ struct DS_StringView
 
 	intptr_t CodepointCount();
 	
+	// The following operations are constexpr, so that e.g. keyword tables can be built at compile time.
+
 	// returns `size` if not found
-	intptr_t Find(DS_StringView other, intptr_t start_from = 0);
+	constexpr intptr_t Find(DS_StringView other, intptr_t start_from = 0) const;
 
 	// returns `size` if not found
-	intptr_t RFind(DS_StringView other, intptr_t start_from = INTPTR_MAX);
+	constexpr intptr_t RFind(DS_StringView other, intptr_t start_from = INTPTR_MAX) const;
 	
 	// returns `Size` if not found
-	intptr_t FindChar(char other, intptr_t start_from = 0);
+	constexpr intptr_t FindChar(char other, intptr_t start_from = 0) const;
 
 	// returns `Size` if not found
-	intptr_t RFindChar(char other, intptr_t start_from = INTPTR_MAX);
+	constexpr intptr_t RFindChar(char other, intptr_t start_from = INTPTR_MAX) const;
 	
 	// Find "split_by", set this string to the string after `split_by`, return the string before `split_by`
-	DS_StringView Split(DS_StringView split_by);
+	constexpr DS_StringView Split(DS_StringView split_by);
 
-	DS_StringView Slice(intptr_t from, intptr_t to = INTPTR_MAX);
+	constexpr DS_StringView Slice(intptr_t from, intptr_t to = INTPTR_MAX) const;
 
 	DS_String Clone(DS_Arena* arena) const;
 
@@ -275,40 +300,34 @@ struct DS_StringView
 	
 	// ------------------------------------------------------------------------
 
-	bool operator==(DS_StringView other) { return Size == other.Size && memcmp(Data, other.Data, Size) == 0; }
-	bool operator!=(DS_StringView other) { return Size != other.Size || memcmp(Data, other.Data, Size) == 0; }
-	bool operator==(const char* other) {
-		intptr_t other_len = other ? strlen(other) : INTPTR_MIN;
-		return Size == other_len && memcmp(Data, other, Size) == 0;
-	}
-	bool operator!=(const char* other) {
-		intptr_t other_len = other ? strlen(other) : INTPTR_MIN;
-		return Size != other_len || memcmp(Data, other, Size) == 0;
-	}
+	constexpr bool operator==(DS_StringView other) const;
+	constexpr bool operator!=(DS_StringView other) const { return !(*this == other); }
+	constexpr bool operator==(const char* other) const;
+	constexpr bool operator!=(const char* other) const { return !(*this == other); }
 
-	operator DS_Slice<char> () const { return DS_Slice<char>(Data, (int32_t)Size); }
+	operator DS_Slice<char> () const { return DS_Slice<char>(Data, Size); }
 
-	DS_StringView() : Data(0), Size(0) {}
+	constexpr DS_StringView() : Data(0), Size(0) {}
 
-	DS_StringView(const char* data, intptr_t size) : Data((char*)data), Size(size) {}
+	constexpr DS_StringView(const char* data, intptr_t size) : Data((char*)data), Size(size) {}
 
 	// Implicitly construct from a string literal without an internal "strlen" call.
 	// To construct from a non-literal C-string, call DS_Str(). It's a separate function and not a constructor to avoid overload-conflict.
 	template <size_t SIZE>
-	DS_StringView(const char (&c_str)[SIZE]) : Data((char*)c_str), Size(SIZE - 1) {}
+	constexpr DS_StringView(const char (&c_str)[SIZE]) : Data((char*)c_str), Size(SIZE - 1) {}
 };
 
 // Null-terminated view to a string
 struct DS_String : public DS_StringView
 {
-	DS_String() : DS_StringView() {}
+	constexpr DS_String() : DS_StringView() {}
 
-	DS_String(const char* data, intptr_t size) : DS_StringView(data, size) {}
+	constexpr DS_String(const char* data, intptr_t size) : DS_StringView(data, size) {}
 	
 	// Implicitly construct from a string literal without an internal "strlen" call.
 	// To construct from a non-literal C-string, call DS_Str(). It's a separate function and not a constructor to avoid overload-conflict.
 	template <size_t SIZE>
-	DS_String(const char (&c_str)[SIZE]) : DS_StringView((char*)c_str, SIZE - 1) {}
+	constexpr DS_String(const char (&c_str)[SIZE]) : DS_StringView((char*)c_str, SIZE - 1) {}
 
 	// As C-string
 	inline char* CStr() const { return Data; }
@@ -322,6 +341,12 @@ static inline DS_String DS_Str(DS_Arena* arena, const char* c_str) {
 	return c_str ? DS_String(c_str, (intptr_t)strlen(c_str)).Clone(arena) : DS_String();
 }
 
+// Fast non-cryptographic 64-bit hash, e.g. for detecting whether some data has changed
+uint64_t DS_Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Same as DS_Hash64(str.Data, str.Size, seed), but can be evaluated at compile time, e.g. for the case labels of a switch on a string.
+constexpr uint64_t DS_HashString(DS_StringView str, uint64_t seed = 0);
+
 // Null-terminated owned dynamic string
 struct DS_DynamicString : public DS_String
 {
@@ -348,6 +373,45 @@ struct DS_DynamicString : public DS_String
 #endif
 };
 
+// Null-terminated string of up to CAPACITY bytes that is stored in place, e.g. for paths, hex digests and cache keys.
+// It's trivially copyable, so it can be stored in hot data structures without pointing elsewhere, and it can be used as
+// a DS_Map key, where the empty string marks an empty slot.
+template<int CAPACITY>
+struct DS_InlineString
+{
+	typedef typename std::conditional<(CAPACITY < 256), uint8_t, uint32_t>::type SizeType;
+
+	char Data[CAPACITY + 1];
+	SizeType Size;
+
+	// ------------------------------------------------------------------------
+
+	inline DS_InlineString() : Size(0) { Data[0] = 0; }
+
+	// `str` must fit.
+	inline DS_InlineString(DS_StringView str) : Size(0) { Data[0] = 0; bool fits = Add(str); DS_ASSERT(fits); (void)fits; }
+
+	inline void Clear() { Size = 0; Data[0] = 0; }
+
+	// Returns false and leaves the string unchanged if the result wouldn't fit.
+	inline bool Add(DS_StringView str);
+
+#ifndef DS_NO_PRINTF
+	// Returns false and leaves the string unchanged if the result wouldn't fit.
+	inline bool Addf(const char* fmt, ...);
+#endif
+
+	inline const char* CStr() const { return Data; }
+
+	inline operator DS_StringView() const { return DS_StringView(Data, Size); }
+
+	inline bool operator==(const DS_InlineString& other) const { return Size == other.Size && memcmp(Data, other.Data, Size) == 0; }
+	inline bool operator!=(const DS_InlineString& other) const { return !(*this == other); }
+
+	// Hash for DS_Map
+	inline explicit operator uint32_t() const { return (uint32_t)DS_Hash64(Data, Size); }
+};
+
 // -- Map, Set ----------------------------------------------------------------
 
 template<typename KEY, typename VALUE>
@@ -416,6 +480,11 @@ struct DS_Map
 	inline bool Find(const KEY& key, VALUE* value);
 	
 	inline VALUE* FindPtr(const KEY& key);
+
+	// * Same as calling FindPtr for each key, i.e. `out_values[i]` is set to point to the value of `keys[i]`, or NULL.
+	// * While a key is probed, the slot of a key further ahead is prefetched, so that the cache misses of the lookups overlap
+	//   instead of each lookup waiting for its own. This helps when the map is larger than the cache.
+	inline void FindMany(DS_Slice<KEY> keys, VALUE** out_values);
 };
 
 template<typename KEY>
@@ -450,6 +519,278 @@ struct DS_Set
 	inline bool Has(const KEY& key);
 };
 
+// -- Concurrent map ----------------------------------------------------------
+
+#define DS_CONCURRENT_MAP_SHARDS_LOG2 4
+
+template<typename KEY, typename VALUE>
+struct DS_ConcurrentMapSlot {
+	std::atomic<KEY> Key; // The default value of KEY means an empty slot
+	VALUE Value;
+};
+
+template<typename KEY, typename VALUE>
+struct DS_ConcurrentMapTable {
+	DS_ConcurrentMapTable* Previous; // The table that this one replaced when the shard grew
+	intptr_t NumSlots;
+	DS_ConcurrentMapSlot<KEY, VALUE>* Slots;
+};
+
+// Hash map that any number of threads can read while other threads add to it, e.g. an index that is shared by worker threads and
+// rarely changes. Entries can only be added, and their values never change, which is what makes the reads simple:
+// * Reads are wait-free: they never take a lock or retry. The value of an entry is written before its key is published with a release
+//   store, so a reader that sees the key also sees the value.
+// * The map is split into shards by key, each with its own lock for adding entries, so writers to different shards don't contend.
+// * When a shard grows, a new table is published with a release store. Readers that are still probing the old table can keep doing so,
+//   since old tables are only freed in Deinit. This costs at most as much memory as the current tables.
+// The key must be a non-zero integer that is well distributed, e.g. a hash. Values must be trivially copyable.
+template<typename KEY, typename VALUE>
+struct DS_ConcurrentMap
+{
+	struct alignas(DS_CACHE_LINE_SIZE) Shard {
+		std::atomic<DS_ConcurrentMapTable<KEY, VALUE>*> Table;
+		std::atomic<intptr_t> NumElems;
+		std::mutex WriteLock;
+	};
+
+	Shard Shards[1 << DS_CONCURRENT_MAP_SHARDS_LOG2];
+	DS_Allocator* Allocator;
+
+	// ------------------------------------------------------------------------
+
+	// If allocator is NULL, the heap allocator is used. The allocator must be thread-safe, since shards can grow at the same time.
+	inline void Init(DS_Allocator* allocator = NULL);
+
+	// Must not be called while other threads use the map.
+	inline void Deinit();
+
+	// * Adds the key with the given value if it isn't in the map yet.
+	// * Returns true if newly added. If the key already exists, returns false and the existing value is left as it is.
+	inline bool Add(const KEY& key, const VALUE& value);
+
+	// Wait-free.
+	inline bool Find(const KEY& key, VALUE* out_value) const;
+
+	inline intptr_t Count() const;
+
+	inline uint32_t ShardIndex(const KEY& key) const;
+};
+
+// -- Bit set -----------------------------------------------------------------
+
+// Fixed-size set of bits, e.g. for tracking which of many blocks or files are dirty. Bits are stored 64 to a word, so counting
+// and searching skip 64 bits at a time (popcnt, tzcnt), and the bulk operations process two words at a time with SSE2.
+// The unused bits in the last word are always zero.
+struct DS_BitSet
+{
+	uint64_t* Words;
+	intptr_t NumBits;
+	DS_Allocator* Allocator;
+
+	// ------------------------------------------------------------------------
+
+	// All bits start cleared. If allocator is NULL, the heap allocator is used.
+	inline void Init(intptr_t num_bits, DS_Allocator* allocator = NULL);
+
+	inline void Deinit();
+
+	// Bits that are added are cleared.
+	inline void Resize(intptr_t num_bits);
+
+	inline intptr_t NumWords() const { return (NumBits + 63) / 64; }
+
+	inline bool Get(intptr_t index) const;
+	inline void Set(intptr_t index);
+	inline void Clear(intptr_t index);
+
+	inline void SetAll();
+	inline void ClearAll();
+
+	// Returns the number of set bits.
+	inline intptr_t Count() const;
+
+	// Returns the index of the first set bit at or after `from`, or NumBits if there is none.
+	inline intptr_t FindNextSet(intptr_t from) const;
+
+	// Returns the index of the first clear bit at or after `from`, or NumBits if there is none.
+	inline intptr_t FindNextClear(intptr_t from) const;
+
+	// Bulk operations with a set of the same size
+	inline void And(const DS_BitSet& other);
+	inline void Or(const DS_BitSet& other);
+	inline void AndNot(const DS_BitSet& other); // Clears the bits that are set in `other`
+};
+
+// -- Binary images -----------------------------------------------------------
+
+// A binary image holds a number of arrays and maps, e.g. an index that is written to a file and loaded again on the next run.
+// Sections are stored at offsets from the start of the image, so the image is relocatable: a file that is mapped into memory
+// can be used in place, without parsing or copying. The element, key and value types must be trivially copyable and must not
+// contain pointers. Values are stored in the byte order of the machine.
+//
+// Layout: DS_ImageHeader, NumSections x DS_ImageSection, then the contents of the sections, each aligned to DS_IMAGE_ALIGNMENT.
+
+#define DS_IMAGE_MAGIC     0x474D4944 // "DIMG"
+#define DS_IMAGE_VERSION   1
+#define DS_IMAGE_ALIGNMENT 16
+
+struct DS_ImageHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Size;     // Size of the whole image in bytes
+	uint64_t Checksum; // DS_Hash64 of everything after the header
+	uint32_t NumSections;
+	uint32_t Reserved;
+};
+
+struct DS_ImageSection
+{
+	uint64_t Offset;   // From the start of the image
+	uint64_t Count;    // Number of elements in an array, or slots in a map
+	uint32_t ItemSize; // sizeof the element or map slot, to catch loading a section as the wrong type
+	int32_t NumElems;  // Number of elements in a map
+};
+
+struct DS_ImageWriter
+{
+	DS_Array<DS_ImageSection> Sections;
+	DS_Array<char> Contents; // The contents of the sections, at offsets relative to the end of the section table
+
+	// ------------------------------------------------------------------------
+
+	// If allocator is NULL, the heap allocator is used.
+	inline void Init(DS_Allocator* allocator = NULL);
+
+	inline void Deinit();
+
+	// Copies the elements into a new section. Returns the index of the section.
+	template<typename T>
+	inline int AddArray(DS_Slice<T> elements);
+
+	// Copies the slots of the map into a new section, so that the map can be loaded without rehashing. Returns the index of the section.
+	template<typename KEY, typename VALUE>
+	inline int AddMap(const DS_Map<KEY, VALUE>& map);
+
+	// Writes the complete image into `out_image`, which should be written to the file as is.
+	inline void Finish(DS_DynamicString* out_image);
+};
+
+// Read-only view into an image, e.g. into a memory-mapped file.
+struct DS_Image
+{
+	DS_StringView Data;
+	const DS_ImageHeader* Header;
+	const DS_ImageSection* Sections;
+
+	// ------------------------------------------------------------------------
+
+	// Returns false if `data` isn't an image of this version, or if it has been truncated. Verifying the checksum reads the whole image,
+	// so it can be skipped if reading only the parts that are used matters more than detecting corruption.
+	// `data` must be aligned to DS_IMAGE_ALIGNMENT (memory-mapped files are page-aligned) and stay valid while the image is used.
+	inline bool Open(DS_StringView data, bool verify_checksum = true);
+
+	// Returns false if the section doesn't exist or wasn't written with the same element type.
+	template<typename T>
+	inline bool GetArray(int section, DS_Slice<T>* out_elements) const;
+
+	// Returns false if the section doesn't exist or wasn't written with the same key and value types. The map points into the image,
+	// so it can be searched with Find, FindPtr and Has, but it must not be modified or deinitialized.
+	template<typename KEY, typename VALUE>
+	inline bool GetMap(int section, DS_Map<KEY, VALUE>* out_map) const;
+};
+
+// -- Sorting -----------------------------------------------------------------
+
+// The sort functions order elements by `key(element)`, which can return anything that has the < operator, e.g. an integer,
+// a float or a DS_StringView. For example, to sort blocks by offset: DS_Sort(blocks, [](const Block& b) { return b.Offset; });
+
+// Introsort: quicksort with a median-of-three pivot, switching to heapsort if the recursion gets too deep and to insertion sort
+// for small ranges. O(n log n) in the worst case. Not stable.
+template<typename T, typename KEY_FN>
+inline void DS_Sort(DS_Slice<T> elements, KEY_FN key);
+
+// LSD radix sort by an unsigned integer key, 8 bits per pass. Stable. The histograms of all passes are built in one read over the
+// elements, and passes where all keys have the same digit are skipped, e.g. the high bytes of small 64-bit keys.
+// A temporary buffer the size of the elements is allocated from `allocator`. If allocator is NULL, the heap allocator is used.
+template<typename T, typename KEY_FN>
+inline void DS_RadixSort(DS_Slice<T> elements, KEY_FN key, DS_Allocator* allocator = NULL);
+
+// Sorts chunks of the elements on separate threads with DS_Sort, then merges them in rounds where every thread merges an equal
+// share of the output. Not stable. Small inputs are sorted on the calling thread.
+// A temporary buffer the size of the elements is allocated from `allocator`. If allocator is NULL, the heap allocator is used.
+template<typename T, typename KEY_FN>
+inline void DS_ParallelSort(DS_Slice<T> elements, KEY_FN key, int num_threads, DS_Allocator* allocator = NULL);
+
+// -- Concurrent queues -------------------------------------------------------
+
+// Lock-free ring buffer for passing values from one producer thread to one consumer thread. The indices written by the producer and
+// by the consumer live on separate cache lines, and each side keeps a cached copy of the other side's index, so that it only needs to
+// read the shared index when the queue looks full (or empty).
+// * The capacity must be a power of two.
+// * T must be trivially copyable.
+template<typename T>
+struct DS_SPSCQueue
+{
+	alignas(DS_CACHE_LINE_SIZE) std::atomic<size_t> Head; // Written by the consumer
+	size_t CachedTail; // The consumer's copy of Tail
+
+	alignas(DS_CACHE_LINE_SIZE) std::atomic<size_t> Tail; // Written by the producer
+	size_t CachedHead; // The producer's copy of Head
+
+	alignas(DS_CACHE_LINE_SIZE) T* Data;
+	size_t Mask;
+	DS_Allocator* Allocator;
+
+	// ------------------------------------------------------------------------
+
+	// If allocator is NULL, the heap allocator is used.
+	inline void Init(size_t capacity, DS_Allocator* allocator = NULL);
+
+	inline void Deinit();
+
+	// Returns false if the queue is full. May only be called by the producer thread.
+	inline bool Push(const T& value);
+
+	// Returns false if the queue is empty. May only be called by the consumer thread.
+	inline bool Pop(T* out_value);
+};
+
+template<typename T>
+struct DS_MPMCQueueCell {
+	std::atomic<size_t> Sequence;
+	T Value;
+};
+
+// Bounded lock-free queue for any number of producer and consumer threads (Dmitry Vyukov's design). Each cell has a sequence number
+// that tells whether it's ready to be written or read for the current lap around the buffer, so producers and consumers only
+// contend on their own position counter with a single compare-and-swap per operation.
+// * The capacity must be a power of two and at least 2.
+// * T must be trivially copyable.
+template<typename T>
+struct DS_MPMCQueue
+{
+	alignas(DS_CACHE_LINE_SIZE) std::atomic<size_t> EnqueuePos;
+	alignas(DS_CACHE_LINE_SIZE) std::atomic<size_t> DequeuePos;
+
+	alignas(DS_CACHE_LINE_SIZE) DS_MPMCQueueCell<T>* Cells;
+	size_t Mask;
+	DS_Allocator* Allocator;
+
+	// ------------------------------------------------------------------------
+
+	// If allocator is NULL, the heap allocator is used.
+	inline void Init(size_t capacity, DS_Allocator* allocator = NULL);
+
+	inline void Deinit();
+
+	// Returns false if the queue is full.
+	inline bool Push(const T& value);
+
+	// Returns false if the queue is empty.
+	inline bool Pop(T* out_value);
+};
+
 // -- Implementation ----------------------------------------------------------
 
 inline void* DS_Allocator::MemAlloc(size_t size, size_t alignment) {
@@ -480,7 +821,7 @@ static void* DS_ArenaAllocatorFunction(DS_Allocator* self, void* old_data, size_
 }
 
 template<typename T>
-inline DS_Array<T>::DS_Array(DS_Arena* arena, int32_t initial_capacity)
+inline DS_Array<T>::DS_Array(DS_Arena* arena, intptr_t initial_capacity)
 {
 	Capacity = 0;
 	Data = NULL;
@@ -492,7 +833,7 @@ inline DS_Array<T>::DS_Array(DS_Arena* arena, int32_t initial_capacity)
 }
 
 template<typename T>
-inline void DS_Array<T>::Init(DS_Allocator* allocator, int32_t initial_capacity)
+inline void DS_Array<T>::Init(DS_Allocator* allocator, intptr_t initial_capacity)
 {
 	Capacity = 0;
 	Data = NULL;
@@ -540,11 +881,11 @@ inline T& DS_Array<T>::Back()
 }
 
 template<typename T>
-inline void DS_Array<T>::Reserve(int32_t reserve_count)
+inline void DS_Array<T>::Reserve(intptr_t reserve_count)
 {
 	if (reserve_count > Capacity)
 	{
-		int32_t old_capacity = Capacity;
+		intptr_t old_capacity = Capacity;
 		while (reserve_count > Capacity) {
 			Capacity = Capacity == 0 ? 8 : Capacity * 2;
 		}
@@ -554,14 +895,15 @@ inline void DS_Array<T>::Reserve(int32_t reserve_count)
 }
 
 template<typename T>
-inline void DS_Array<T>::Resize(int32_t new_count, const T& default_value)
+inline void DS_Array<T>::Resize(intptr_t new_count, const T& default_value)
 {
 	if (new_count > Size)
 	{
 		Reserve(new_count);
-		for (int i = Size; i < new_count; i++)
+		for (intptr_t i = Size; i < new_count; i++)
 			Data[i] = default_value;
 	}
+	Size = new_count;
 }
 
 template<typename T>
@@ -575,14 +917,14 @@ inline void DS_Array<T>::Add(const T& value)
 template<typename T>
 inline void DS_Array<T>::AddSlice(DS_Slice<T> values)
 {
-	Reserve(Size + (int32_t)values.Size);
-	for (int i = 0; i < values.Size; i++)
+	Reserve(Size + values.Size);
+	for (intptr_t i = 0; i < values.Size; i++)
 		Data[Size + i] = values[i];
-	Size = Size + (int32_t)values.Size;
+	Size = Size + values.Size;
 }
 
 template<typename T>
-inline void DS_Array<T>::Insert(int32_t at, const T& value, int n)
+inline void DS_Array<T>::Insert(intptr_t at, const T& value, intptr_t n)
 {
 	DS_ASSERT(at <= Size);
 	Reserve(Size + n);
@@ -590,14 +932,14 @@ inline void DS_Array<T>::Insert(int32_t at, const T& value, int n)
 	char* insert_location = (char*)Data + at * sizeof(T);
 	memmove(insert_location + n * sizeof(T), insert_location, (Size - at) * sizeof(T));
 
-	for (int i = 0; i < n; i++)
+	for (intptr_t i = 0; i < n; i++)
 		((T*)insert_location)[i] = value;
 	
 	Size += n;
 }
 
 template<typename T>
-inline T& DS_Array<T>::Remove(int32_t index, int n)
+inline void DS_Array<T>::Remove(intptr_t index, intptr_t n)
 {
 	DS_ASSERT(index + n <= Size);
 
@@ -609,7 +951,7 @@ inline T& DS_Array<T>::Remove(int32_t index, int n)
 }
 
 template<typename T>
-inline T& DS_Array<T>::PopBack(int n)
+inline T& DS_Array<T>::PopBack(intptr_t n)
 {
 	DS_ASSERT(Size >= n);
 	Size -= n;
@@ -619,8 +961,8 @@ inline T& DS_Array<T>::PopBack(int n)
 template<typename T>
 inline void DS_Array<T>::ReverseOrder()
 {
-	int i = 0;
-	int j = Size - 1;
+	intptr_t i = 0;
+	intptr_t j = Size - 1;
 
 	T temp;
 	while (i < j) {
@@ -632,6 +974,154 @@ inline void DS_Array<T>::ReverseOrder()
 	}
 }
 
+// At compile time, the standard library functions can't be called, so plain loops are used instead.
+constexpr bool DS_MemEqual(const char* a, const char* b, intptr_t size)
+{
+	if (!std::is_constant_evaluated())
+		return memcmp(a, b, size) == 0;
+	for (intptr_t i = 0; i < size; i++)
+		if (a[i] != b[i]) return false;
+	return true;
+}
+
+constexpr intptr_t DS_StrLen(const char* c_str)
+{
+	if (!std::is_constant_evaluated())
+		return (intptr_t)strlen(c_str);
+	intptr_t size = 0;
+	while (c_str[size]) size++;
+	return size;
+}
+
+constexpr intptr_t DS_StringView::Find(DS_StringView other, intptr_t start_from) const
+{
+	DS_ASSERT(start_from >= 0 && start_from <= Size);
+	intptr_t result = Size;
+	if (other.Size <= Size)
+	{
+		const char* ptr = Data + start_from;
+		const char* end = Data + Size - other.Size;
+		for (; ptr <= end; ptr++)
+		{
+			if (DS_MemEqual(ptr, other.Data, other.Size)) {
+				result = ptr - Data;
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+constexpr intptr_t DS_StringView::RFind(DS_StringView other, intptr_t start_from) const
+{
+	intptr_t result = Size;
+	if (other.Size <= Size)
+	{
+		// Indices rather than pointers, since pointers before the start of the string aren't allowed in constant expressions
+		intptr_t i = (start_from >= Size ? Size : start_from) - other.Size;
+		for (; i >= 0; i--)
+		{
+			if (DS_MemEqual(Data + i, other.Data, other.Size)) {
+				result = i;
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+constexpr intptr_t DS_StringView::FindChar(char other, intptr_t start_from) const
+{
+	DS_ASSERT(start_from >= 0 && start_from <= Size);
+	intptr_t result = Size;
+	const char* ptr = Data + start_from;
+	const char* end = Data + Size;
+	for (; ptr < end; ptr++)
+	{
+		if (*ptr == other) {
+			result = ptr - Data;
+			break;
+		}
+	}
+	return result;
+}
+
+constexpr intptr_t DS_StringView::RFindChar(char other, intptr_t start_from) const
+{
+	intptr_t result = Size;
+	intptr_t i = (start_from >= Size ? Size : start_from) - 1;
+	for (; i >= 0; i--)
+	{
+		if (Data[i] == other) {
+			result = i;
+			break;
+		}
+	}
+	return result;
+}
+
+constexpr DS_StringView DS_StringView::Split(DS_StringView split_by)
+{
+	intptr_t offset = Find(split_by);
+	DS_StringView result = {Data, offset};
+	intptr_t advance = offset + split_by.Size > Size ? Size : offset + split_by.Size;
+	Data += advance;
+	Size -= advance;
+	return result;
+}
+
+constexpr DS_StringView DS_StringView::Slice(intptr_t from, intptr_t to) const
+{
+	if (to == INTPTR_MAX) to = Size;
+	DS_ASSERT(from >= 0);
+	DS_ASSERT(to <= Size);
+	DS_ASSERT(to >= from);
+	return DS_StringView(Data + from, to - from);
+}
+
+constexpr bool DS_StringView::operator==(DS_StringView other) const
+{
+	return Size == other.Size && DS_MemEqual(Data, other.Data, Size);
+}
+
+constexpr bool DS_StringView::operator==(const char* other) const
+{
+	intptr_t other_len = other ? DS_StrLen(other) : INTPTR_MIN;
+	return Size == other_len && DS_MemEqual(Data, other, Size);
+}
+
+constexpr uint64_t DS_HashString(DS_StringView str, uint64_t seed)
+{
+	if (!std::is_constant_evaluated())
+		return DS_Hash64(str.Data, (size_t)str.Size, seed);
+
+	// The same steps as in DS_Hash64 in ds.cpp, with the little-endian words assembled byte by byte
+	const uint64_t k = 0x9E3779B97F4A7C15;
+	uint64_t hash = seed ^ ((uint64_t)str.Size * k);
+
+	intptr_t i = 0;
+	for (; i + 8 <= str.Size; i += 8)
+	{
+		uint64_t word = 0;
+		for (int j = 0; j < 8; j++)
+			word |= (uint64_t)(uint8_t)str.Data[i + j] << (j * 8);
+		hash = (hash ^ word) * k;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t tail = 0;
+	for (int j = 0; i + j < str.Size; j++)
+		tail |= (uint64_t)(uint8_t)str.Data[i + j] << (j * 8);
+	hash = (hash ^ tail) * k;
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCD;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53;
+	hash ^= hash >> 33;
+	return hash;
+}
+
 inline DS_DynamicString::DS_DynamicString(DS_Arena* arena, intptr_t initial_capacity)
 {
 	Capacity = 0;
@@ -688,6 +1178,36 @@ inline void DS_DynamicString::Add(DS_StringView str)
 	Data[Size] = 0;
 }
 
+template<int CAPACITY>
+inline bool DS_InlineString<CAPACITY>::Add(DS_StringView str)
+{
+	if (str.Size > CAPACITY - (intptr_t)Size)
+		return false;
+	memcpy(Data + Size, str.Data, str.Size);
+	Size += (SizeType)str.Size;
+	Data[Size] = 0;
+	return true;
+}
+
+#ifndef DS_NO_PRINTF
+template<int CAPACITY>
+inline bool DS_InlineString<CAPACITY>::Addf(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int required = vsnprintf(Data + Size, CAPACITY + 1 - Size, fmt, args);
+	va_end(args);
+
+	if (required < 0 || required > CAPACITY - (int)Size)
+	{
+		Data[Size] = 0; // Undo the truncated output
+		return false;
+	}
+	Size += (SizeType)required;
+	return true;
+}
+#endif
+
 #ifndef DS_NO_PRINTF
 inline void DS_DynamicString::Addf(const char* fmt, ...)
 {
@@ -780,6 +1300,32 @@ inline VALUE* DS_Map<KEY, VALUE>::FindPtr(const KEY& key)
 	}
 }
 
+// How many keys ahead DS_Map::FindMany prefetches. It's about the number of cache misses that a core can have in flight.
+#define DS_MAP_PREFETCH_DISTANCE 16
+
+template<typename KEY, typename VALUE>
+inline void DS_Map<KEY, VALUE>::FindMany(DS_Slice<KEY> keys, VALUE** out_values)
+{
+	if (NumSlots == 0)
+	{
+		for (intptr_t i = 0; i < keys.Size; i++)
+			out_values[i] = NULL;
+		return;
+	}
+
+	uint32_t mask = (uint32_t)NumSlots - 1;
+	intptr_t prefetched = keys.Size < DS_MAP_PREFETCH_DISTANCE ? keys.Size : DS_MAP_PREFETCH_DISTANCE;
+	for (intptr_t i = 0; i < prefetched; i++)
+		DS_Prefetch(&Data[(uint32_t)keys.Data[i] & mask]);
+
+	for (intptr_t i = 0; i < keys.Size; i++)
+	{
+		if (i + DS_MAP_PREFETCH_DISTANCE < keys.Size)
+			DS_Prefetch(&Data[(uint32_t)keys.Data[i + DS_MAP_PREFETCH_DISTANCE] & mask]);
+		out_values[i] = FindPtr(keys.Data[i]);
+	}
+}
+
 template<typename KEY, typename VALUE>
 inline void DS_Map<KEY, VALUE>::Resize(int num_slots)
 {
@@ -1090,3 +1636,828 @@ inline bool DS_Set<KEY>::Remove(const KEY& key)
 
 	return removed;
 }
+
+template<typename KEY, typename VALUE>
+inline void DS_ConcurrentMap<KEY, VALUE>::Init(DS_Allocator* allocator)
+{
+	static_assert(std::atomic<KEY>::is_always_lock_free, "DS_ConcurrentMap requires a key type with lock-free atomics");
+	static_assert(std::is_trivially_copyable<VALUE>::value, "DS_ConcurrentMap requires a trivially copyable value type");
+
+	Allocator = allocator ? allocator : DS_HeapAllocator();
+	for (int i = 0; i < (1 << DS_CONCURRENT_MAP_SHARDS_LOG2); i++)
+	{
+		Shards[i].Table.store(NULL, std::memory_order_relaxed);
+		Shards[i].NumElems.store(0, std::memory_order_relaxed);
+	}
+}
+
+template<typename KEY, typename VALUE>
+inline void DS_ConcurrentMap<KEY, VALUE>::Deinit()
+{
+	for (int i = 0; i < (1 << DS_CONCURRENT_MAP_SHARDS_LOG2); i++)
+	{
+		for (DS_ConcurrentMapTable<KEY, VALUE>* table = Shards[i].Table.load(std::memory_order_relaxed); table;)
+		{
+			DS_ConcurrentMapTable<KEY, VALUE>* previous = table->Previous;
+			Allocator->MemFree(table);
+			table = previous;
+		}
+		Shards[i].Table.store(NULL, std::memory_order_relaxed);
+	}
+}
+
+template<typename KEY, typename VALUE>
+inline uint32_t DS_ConcurrentMap<KEY, VALUE>::ShardIndex(const KEY& key) const
+{
+	// The slot index comes from the low bits of the key, so the shard is picked from all of its bits
+	uint64_t k = (uint64_t)key;
+	return (uint32_t)((k * 0x9E3779B97F4A7C15) >> (64 - DS_CONCURRENT_MAP_SHARDS_LOG2));
+}
+
+template<typename KEY, typename VALUE>
+inline bool DS_ConcurrentMap<KEY, VALUE>::Find(const KEY& key, VALUE* out_value) const
+{
+	DS_ASSERT(key != KEY{});
+	const DS_ConcurrentMapTable<KEY, VALUE>* table = Shards[ShardIndex(key)].Table.load(std::memory_order_acquire);
+	if (table == NULL)
+		return false;
+
+	// Tables are never more than half full, so the probing always ends at an empty slot
+	uint32_t mask = (uint32_t)table->NumSlots - 1;
+	for (uint32_t index = (uint32_t)key & mask;; index = (index + 1) & mask)
+	{
+		KEY slot_key = table->Slots[index].Key.load(std::memory_order_acquire);
+		if (slot_key == KEY{})
+			return false;
+		if (slot_key == key)
+		{
+			*out_value = table->Slots[index].Value;
+			return true;
+		}
+	}
+}
+
+template<typename KEY, typename VALUE>
+inline bool DS_ConcurrentMap<KEY, VALUE>::Add(const KEY& key, const VALUE& value)
+{
+	DS_ASSERT(key != KEY{});
+	Shard& shard = Shards[ShardIndex(key)];
+	std::lock_guard<std::mutex> lock(shard.WriteLock);
+
+	DS_ConcurrentMapTable<KEY, VALUE>* table = shard.Table.load(std::memory_order_relaxed);
+	intptr_t num_elems = shard.NumElems.load(std::memory_order_relaxed);
+	if (table == NULL || (num_elems + 1) * 2 > table->NumSlots)
+	{
+		// Grow into a new table. It's filled in before it's published, so readers see either the old or the complete new table.
+		intptr_t num_slots = table ? table->NumSlots * 2 : 16;
+		DS_ASSERT(num_slots <= ((intptr_t)1 << 32));
+		size_t slots_offset = (sizeof(DS_ConcurrentMapTable<KEY, VALUE>) + alignof(DS_ConcurrentMapSlot<KEY, VALUE>) - 1) & ~(alignof(DS_ConcurrentMapSlot<KEY, VALUE>) - 1);
+		char* memory = (char*)Allocator->MemAlloc(slots_offset + num_slots * sizeof(DS_ConcurrentMapSlot<KEY, VALUE>), DS_CACHE_LINE_SIZE);
+
+		DS_ConcurrentMapTable<KEY, VALUE>* new_table = (DS_ConcurrentMapTable<KEY, VALUE>*)memory;
+		new_table->Previous = table;
+		new_table->NumSlots = num_slots;
+		new_table->Slots = (DS_ConcurrentMapSlot<KEY, VALUE>*)(memory + slots_offset);
+		for (intptr_t i = 0; i < num_slots; i++)
+			new (&new_table->Slots[i].Key) std::atomic<KEY>(KEY{});
+
+		if (table)
+		{
+			uint32_t new_mask = (uint32_t)num_slots - 1;
+			for (intptr_t i = 0; i < table->NumSlots; i++)
+			{
+				KEY old_key = table->Slots[i].Key.load(std::memory_order_relaxed);
+				if (old_key == KEY{})
+					continue;
+
+				uint32_t index = (uint32_t)old_key & new_mask;
+				while (new_table->Slots[index].Key.load(std::memory_order_relaxed) != KEY{})
+					index = (index + 1) & new_mask;
+				new_table->Slots[index].Value = table->Slots[i].Value;
+				new_table->Slots[index].Key.store(old_key, std::memory_order_relaxed);
+			}
+		}
+
+		shard.Table.store(new_table, std::memory_order_release);
+		table = new_table;
+	}
+
+	uint32_t mask = (uint32_t)table->NumSlots - 1;
+	uint32_t index = (uint32_t)key & mask;
+	for (;; index = (index + 1) & mask)
+	{
+		KEY slot_key = table->Slots[index].Key.load(std::memory_order_relaxed);
+		if (slot_key == key)
+			return false;
+		if (slot_key == KEY{})
+			break;
+	}
+
+	table->Slots[index].Value = value;
+	table->Slots[index].Key.store(key, std::memory_order_release);
+	shard.NumElems.store(num_elems + 1, std::memory_order_relaxed);
+	return true;
+}
+
+template<typename KEY, typename VALUE>
+inline intptr_t DS_ConcurrentMap<KEY, VALUE>::Count() const
+{
+	intptr_t count = 0;
+	for (int i = 0; i < (1 << DS_CONCURRENT_MAP_SHARDS_LOG2); i++)
+		count += Shards[i].NumElems.load(std::memory_order_relaxed);
+	return count;
+}
+
+inline void DS_BitSet::Init(intptr_t num_bits, DS_Allocator* allocator)
+{
+	DS_ASSERT(num_bits >= 0);
+	Allocator = allocator ? allocator : DS_HeapAllocator();
+	NumBits = num_bits;
+	Words = NULL;
+	if (num_bits > 0)
+	{
+		Words = (uint64_t*)Allocator->MemAlloc(NumWords() * sizeof(uint64_t));
+		memset(Words, 0, NumWords() * sizeof(uint64_t));
+	}
+}
+
+inline void DS_BitSet::Deinit()
+{
+	if (Words)
+		Allocator->MemFree(Words);
+
+#ifndef DS_NO_DEBUG_CHECKS
+	memset(this, 0xCC, sizeof(*this));
+#endif
+}
+
+inline void DS_BitSet::Resize(intptr_t num_bits)
+{
+	DS_ASSERT(num_bits >= 0);
+	intptr_t old_num_words = NumWords();
+	intptr_t new_num_words = (num_bits + 63) / 64;
+	if (new_num_words != old_num_words)
+	{
+		if (new_num_words == 0)
+		{
+			Allocator->MemFree(Words);
+			Words = NULL;
+		}
+		else
+		{
+			Words = (uint64_t*)Allocator->MemRealloc(Words, old_num_words * sizeof(uint64_t), new_num_words * sizeof(uint64_t));
+			if (new_num_words > old_num_words)
+				memset(Words + old_num_words, 0, (new_num_words - old_num_words) * sizeof(uint64_t));
+		}
+	}
+
+	// When shrinking, the bits past the new end must be cleared
+	NumBits = num_bits;
+	if (NumBits % 64 != 0)
+		Words[NumBits / 64] &= ~0ull >> (64 - NumBits % 64);
+}
+
+inline bool DS_BitSet::Get(intptr_t index) const
+{
+	DS_ASSERT(index >= 0 && index < NumBits);
+	return (Words[index / 64] >> (index % 64)) & 1;
+}
+
+inline void DS_BitSet::Set(intptr_t index)
+{
+	DS_ASSERT(index >= 0 && index < NumBits);
+	Words[index / 64] |= 1ull << (index % 64);
+}
+
+inline void DS_BitSet::Clear(intptr_t index)
+{
+	DS_ASSERT(index >= 0 && index < NumBits);
+	Words[index / 64] &= ~(1ull << (index % 64));
+}
+
+inline void DS_BitSet::SetAll()
+{
+	if (NumBits == 0)
+		return;
+	memset(Words, 0xFF, NumWords() * sizeof(uint64_t));
+	if (NumBits % 64 != 0)
+		Words[NumBits / 64] = ~0ull >> (64 - NumBits % 64);
+}
+
+inline void DS_BitSet::ClearAll()
+{
+	if (NumBits > 0)
+		memset(Words, 0, NumWords() * sizeof(uint64_t));
+}
+
+inline intptr_t DS_BitSet::Count() const
+{
+	intptr_t count = 0;
+	intptr_t num_words = NumWords();
+	for (intptr_t i = 0; i < num_words; i++)
+		count += std::popcount(Words[i]);
+	return count;
+}
+
+inline intptr_t DS_BitSet::FindNextSet(intptr_t from) const
+{
+	DS_ASSERT(from >= 0);
+	if (from >= NumBits)
+		return NumBits;
+
+	intptr_t i = from / 64;
+	uint64_t word = Words[i] & (~0ull << (from % 64));
+	intptr_t num_words = NumWords();
+	while (word == 0)
+	{
+		if (++i == num_words)
+			return NumBits;
+		word = Words[i];
+	}
+	return i * 64 + std::countr_zero(word);
+}
+
+inline intptr_t DS_BitSet::FindNextClear(intptr_t from) const
+{
+	DS_ASSERT(from >= 0);
+	if (from >= NumBits)
+		return NumBits;
+
+	intptr_t i = from / 64;
+	uint64_t word = ~Words[i] & (~0ull << (from % 64));
+	intptr_t num_words = NumWords();
+	while (word == 0)
+	{
+		if (++i == num_words)
+			return NumBits;
+		word = ~Words[i];
+	}
+
+	// The unused bits of the last word are clear, so the result can be past the end
+	intptr_t result = i * 64 + std::countr_zero(word);
+	return result < NumBits ? result : NumBits;
+}
+
+inline void DS_BitSet::And(const DS_BitSet& other)
+{
+	DS_ASSERT(other.NumBits == NumBits);
+	intptr_t num_words = NumWords();
+	intptr_t i = 0;
+#ifdef DS_HAS_SSE2
+	for (; i + 2 <= num_words; i += 2)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(Words + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(other.Words + i));
+		_mm_storeu_si128((__m128i*)(Words + i), _mm_and_si128(a, b));
+	}
+#endif
+	for (; i < num_words; i++)
+		Words[i] &= other.Words[i];
+}
+
+inline void DS_BitSet::Or(const DS_BitSet& other)
+{
+	DS_ASSERT(other.NumBits == NumBits);
+	intptr_t num_words = NumWords();
+	intptr_t i = 0;
+#ifdef DS_HAS_SSE2
+	for (; i + 2 <= num_words; i += 2)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(Words + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(other.Words + i));
+		_mm_storeu_si128((__m128i*)(Words + i), _mm_or_si128(a, b));
+	}
+#endif
+	for (; i < num_words; i++)
+		Words[i] |= other.Words[i];
+}
+
+inline void DS_BitSet::AndNot(const DS_BitSet& other)
+{
+	DS_ASSERT(other.NumBits == NumBits);
+	intptr_t num_words = NumWords();
+	intptr_t i = 0;
+#ifdef DS_HAS_SSE2
+	for (; i + 2 <= num_words; i += 2)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(Words + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(other.Words + i));
+		_mm_storeu_si128((__m128i*)(Words + i), _mm_andnot_si128(b, a)); // (~b) & a
+	}
+#endif
+	for (; i < num_words; i++)
+		Words[i] &= ~other.Words[i];
+}
+
+inline void DS_ImageWriter::Init(DS_Allocator* allocator)
+{
+	Sections.Init(allocator);
+	Contents.Init(allocator);
+}
+
+inline void DS_ImageWriter::Deinit()
+{
+	Sections.Deinit();
+	Contents.Deinit();
+}
+
+template<typename T>
+inline int DS_ImageWriter::AddArray(DS_Slice<T> elements)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "DS_ImageWriter requires trivially copyable types");
+	static_assert(alignof(T) <= DS_IMAGE_ALIGNMENT, "DS_ImageWriter doesn't support types that need more than DS_IMAGE_ALIGNMENT");
+
+	intptr_t offset = (Contents.Size + DS_IMAGE_ALIGNMENT - 1) & ~(intptr_t)(DS_IMAGE_ALIGNMENT - 1);
+	intptr_t size = elements.Size * sizeof(T);
+	Contents.Resize(offset + size, 0);
+	if (size > 0)
+		memcpy(Contents.Data + offset, elements.Data, size);
+
+	DS_ImageSection section = {};
+	section.Offset = (uint64_t)offset;
+	section.Count = (uint64_t)elements.Size;
+	section.ItemSize = sizeof(T);
+	Sections.Add(section);
+	return (int)Sections.Size - 1;
+}
+
+template<typename KEY, typename VALUE>
+inline int DS_ImageWriter::AddMap(const DS_Map<KEY, VALUE>& map)
+{
+	int index = AddArray(DS_Slice<DS_MapSlot<KEY, VALUE>>(map.Data, map.NumSlots));
+	Sections[index].NumElems = map.NumElems;
+	return index;
+}
+
+inline void DS_ImageWriter::Finish(DS_DynamicString* out_image)
+{
+	intptr_t table_size = sizeof(DS_ImageHeader) + Sections.Size * sizeof(DS_ImageSection);
+	intptr_t contents_offset = (table_size + DS_IMAGE_ALIGNMENT - 1) & ~(intptr_t)(DS_IMAGE_ALIGNMENT - 1);
+	intptr_t image_size = contents_offset + Contents.Size;
+
+	out_image->Reserve(image_size + 1);
+	char* image = out_image->Data;
+	memset(image, 0, contents_offset);
+
+	DS_ImageHeader* header = (DS_ImageHeader*)image;
+	header->Magic = DS_IMAGE_MAGIC;
+	header->Version = DS_IMAGE_VERSION;
+	header->Size = (uint64_t)image_size;
+	header->NumSections = (uint32_t)Sections.Size;
+
+	DS_ImageSection* sections = (DS_ImageSection*)(image + sizeof(DS_ImageHeader));
+	for (intptr_t i = 0; i < Sections.Size; i++)
+	{
+		sections[i] = Sections[i];
+		sections[i].Offset += (uint64_t)contents_offset;
+	}
+
+	if (Contents.Size > 0)
+		memcpy(image + contents_offset, Contents.Data, Contents.Size);
+	header->Checksum = DS_Hash64(image + sizeof(DS_ImageHeader), image_size - sizeof(DS_ImageHeader));
+
+	out_image->Size = image_size;
+	out_image->Data[image_size] = 0;
+}
+
+inline bool DS_Image::Open(DS_StringView data, bool verify_checksum)
+{
+	*this = {};
+	if (((uintptr_t)data.Data & (DS_IMAGE_ALIGNMENT - 1)) != 0 || data.Size < (intptr_t)sizeof(DS_ImageHeader))
+		return false;
+
+	const DS_ImageHeader* header = (const DS_ImageHeader*)data.Data;
+	if (header->Magic != DS_IMAGE_MAGIC || header->Version != DS_IMAGE_VERSION || header->Size != (uint64_t)data.Size)
+		return false;
+
+	uint64_t table_size = sizeof(DS_ImageHeader) + (uint64_t)header->NumSections * sizeof(DS_ImageSection);
+	if (table_size > header->Size)
+		return false;
+
+	if (verify_checksum && DS_Hash64(data.Data + sizeof(DS_ImageHeader), data.Size - sizeof(DS_ImageHeader)) != header->Checksum)
+		return false;
+
+	// The sections must lie within the image, so that a corrupted image without checksum verification can't point outside of it
+	const DS_ImageSection* sections = (const DS_ImageSection*)(data.Data + sizeof(DS_ImageHeader));
+	for (uint32_t i = 0; i < header->NumSections; i++)
+	{
+		const DS_ImageSection& section = sections[i];
+		if (section.Offset % DS_IMAGE_ALIGNMENT != 0 || section.Offset > header->Size || section.ItemSize == 0 ||
+			section.Count > (header->Size - section.Offset) / section.ItemSize)
+			return false;
+	}
+
+	Data = data;
+	Header = header;
+	Sections = sections;
+	return true;
+}
+
+template<typename T>
+inline bool DS_Image::GetArray(int section, DS_Slice<T>* out_elements) const
+{
+	if (Header == NULL || section < 0 || (uint32_t)section >= Header->NumSections || Sections[section].ItemSize != sizeof(T))
+		return false;
+
+	out_elements->Data = (T*)(Data.Data + Sections[section].Offset);
+	out_elements->Size = (intptr_t)Sections[section].Count;
+	return true;
+}
+
+template<typename KEY, typename VALUE>
+inline bool DS_Image::GetMap(int section, DS_Map<KEY, VALUE>* out_map) const
+{
+	DS_Slice<DS_MapSlot<KEY, VALUE>> slots;
+	if (!GetArray(section, &slots))
+		return false;
+
+	// DS_Map expects a power of two number of slots with at least one empty slot
+	intptr_t num_elems = Sections[section].NumElems;
+	if ((slots.Size & (slots.Size - 1)) != 0 || slots.Size > INT32_MAX || num_elems < 0 || (slots.Size > 0 && num_elems >= slots.Size))
+		return false;
+
+	out_map->Data = slots.Data;
+	out_map->NumElems = (int32_t)num_elems;
+	out_map->NumSlots = (int32_t)slots.Size;
+	out_map->Allocator = NULL;
+	return true;
+}
+
+// Ranges that are at most this long are sorted with insertion sort
+#define DS_INSERTION_SORT_THRESHOLD 16
+
+// DS_ParallelSort doesn't split the elements into chunks smaller than this
+#define DS_PARALLEL_SORT_MIN_CHUNK 16384
+
+template<typename T, typename KEY_FN>
+inline void DS_InsertionSort(T* data, intptr_t n, KEY_FN& key)
+{
+	for (intptr_t i = 1; i < n; i++)
+	{
+		T value = data[i];
+		auto value_key = key(value);
+		intptr_t j = i;
+		for (; j > 0 && value_key < key(data[j - 1]); j--)
+			data[j] = data[j - 1];
+		data[j] = value;
+	}
+}
+
+template<typename T, typename KEY_FN>
+inline void DS_HeapSort(T* data, intptr_t n, KEY_FN& key)
+{
+	auto sift_down = [&](intptr_t root, intptr_t end) {
+		for (;;)
+		{
+			intptr_t child = root * 2 + 1;
+			if (child >= end) break;
+			if (child + 1 < end && key(data[child]) < key(data[child + 1])) child++;
+			if (!(key(data[root]) < key(data[child]))) break;
+			T tmp = data[root]; data[root] = data[child]; data[child] = tmp;
+			root = child;
+		}
+	};
+
+	for (intptr_t i = n / 2 - 1; i >= 0; i--)
+		sift_down(i, n);
+	for (intptr_t end = n - 1; end > 0; end--)
+	{
+		T tmp = data[0]; data[0] = data[end]; data[end] = tmp;
+		sift_down(0, end);
+	}
+}
+
+template<typename T, typename KEY_FN>
+inline void DS_IntroSort(T* data, intptr_t n, int depth_limit, KEY_FN& key)
+{
+	while (n > DS_INSERTION_SORT_THRESHOLD)
+	{
+		if (depth_limit == 0)
+		{
+			DS_HeapSort(data, n, key);
+			return;
+		}
+		depth_limit--;
+
+		// Order the first, middle and last elements, and use the middle one as the pivot
+		intptr_t mid = n / 2;
+		T tmp;
+		if (key(data[mid]) < key(data[0]))     { tmp = data[mid]; data[mid] = data[0]; data[0] = tmp; }
+		if (key(data[n - 1]) < key(data[mid])) { tmp = data[mid]; data[mid] = data[n - 1]; data[n - 1] = tmp; }
+		if (key(data[mid]) < key(data[0]))     { tmp = data[mid]; data[mid] = data[0]; data[0] = tmp; }
+		auto pivot = key(data[mid]);
+
+		// Hoare partition: afterwards, [0, j] <= pivot <= [j + 1, n)
+		intptr_t i = -1, j = n;
+		for (;;)
+		{
+			do i++; while (key(data[i]) < pivot);
+			do j--; while (pivot < key(data[j]));
+			if (i >= j) break;
+			tmp = data[i]; data[i] = data[j]; data[j] = tmp;
+		}
+
+		// Recurse into the smaller side, so that the stack depth stays O(log n)
+		intptr_t left_size = j + 1;
+		if (left_size < n - left_size)
+		{
+			DS_IntroSort(data, left_size, depth_limit, key);
+			data += left_size;
+			n -= left_size;
+		}
+		else
+		{
+			DS_IntroSort(data + left_size, n - left_size, depth_limit, key);
+			n = left_size;
+		}
+	}
+	DS_InsertionSort(data, n, key);
+}
+
+template<typename T, typename KEY_FN>
+inline void DS_Sort(DS_Slice<T> elements, KEY_FN key)
+{
+	int depth_limit = 0;
+	for (intptr_t n = elements.Size; n > 1; n /= 2)
+		depth_limit += 2;
+	DS_IntroSort(elements.Data, elements.Size, depth_limit, key);
+}
+
+template<typename T, typename KEY_FN>
+inline void DS_RadixSort(DS_Slice<T> elements, KEY_FN key, DS_Allocator* allocator)
+{
+	typedef typename std::decay<decltype(key(elements.Data[0]))>::type KEY;
+	static_assert(std::is_unsigned<KEY>::value, "DS_RadixSort requires an unsigned integer key");
+	static_assert(std::is_trivially_copyable<T>::value, "DS_RadixSort requires a trivially copyable type");
+	if (elements.Size < 2)
+		return;
+
+	intptr_t counts[sizeof(KEY)][256] = {};
+	for (intptr_t i = 0; i < elements.Size; i++)
+	{
+		KEY k = key(elements.Data[i]);
+		for (int d = 0; d < (int)sizeof(KEY); d++)
+			counts[d][(k >> (d * 8)) & 0xFF]++;
+	}
+
+	allocator = allocator ? allocator : DS_HeapAllocator();
+	T* temp = (T*)allocator->MemAlloc(elements.Size * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+
+	T* src = elements.Data;
+	T* dst = temp;
+	KEY first_key = key(elements.Data[0]);
+	for (int d = 0; d < (int)sizeof(KEY); d++)
+	{
+		if (counts[d][(first_key >> (d * 8)) & 0xFF] == elements.Size)
+			continue; // All keys have the same digit
+
+		intptr_t offsets[256];
+		intptr_t offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			offsets[b] = offset;
+			offset += counts[d][b];
+		}
+
+		for (intptr_t i = 0; i < elements.Size; i++)
+			dst[offsets[(key(src[i]) >> (d * 8)) & 0xFF]++] = src[i];
+
+		T* swap = src; src = dst; dst = swap;
+	}
+
+	if (src != elements.Data)
+		memcpy(elements.Data, src, elements.Size * sizeof(T));
+	allocator->MemFree(temp);
+}
+
+// Returns how many of the first `k` elements of the stable merge of `a` and `b` come from `a`.
+template<typename T, typename KEY_FN>
+inline intptr_t DS_MergeCoRank(intptr_t k, const T* a, intptr_t a_size, const T* b, intptr_t b_size, KEY_FN& key)
+{
+	intptr_t lo = k > b_size ? k - b_size : 0;
+	intptr_t hi = k < a_size ? k : a_size;
+	while (lo < hi)
+	{
+		// Taking `mid` elements from `a` is valid if a[mid - 1] goes before b[k - mid], i.e. isn't greater than it
+		intptr_t mid = (lo + hi + 1) / 2;
+		intptr_t j = k - mid;
+		if (j >= b_size || !(key(b[j]) < key(a[mid - 1]))) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+template<typename T, typename KEY_FN>
+inline void DS_ParallelSort(DS_Slice<T> elements, KEY_FN key, int num_threads, DS_Allocator* allocator)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "DS_ParallelSort requires a trivially copyable type");
+
+	// The merges alternate between the elements and a temporary buffer, so the number of chunks is a power of two
+	intptr_t num_chunks = 1;
+	while (num_chunks * 2 <= num_threads && elements.Size / (num_chunks * 2) >= DS_PARALLEL_SORT_MIN_CHUNK)
+		num_chunks *= 2;
+
+	if (num_chunks == 1)
+	{
+		DS_Sort(elements, key);
+		return;
+	}
+
+	auto chunk_start = [&](intptr_t chunk) { return elements.Size * chunk / num_chunks; };
+
+	auto run_in_parallel = [&](auto&& fn) {
+		// The calling thread does the first part itself
+		std::thread threads[64];
+		int num_started = 0;
+		for (intptr_t i = 1; i < num_chunks; i++)
+		{
+			if (num_started < 64) threads[num_started++] = std::thread(fn, i);
+			else fn(i);
+		}
+		fn(0);
+		for (int i = 0; i < num_started; i++)
+			threads[i].join();
+	};
+
+	run_in_parallel([&](intptr_t chunk) {
+		intptr_t start = chunk_start(chunk);
+		DS_Sort(DS_Slice<T>(elements.Data + start, chunk_start(chunk + 1) - start), key);
+	});
+
+	allocator = allocator ? allocator : DS_HeapAllocator();
+	T* temp = (T*)allocator->MemAlloc(elements.Size * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	T* src = elements.Data;
+	T* dst = temp;
+
+	// In each round, pairs of sorted runs of `width` chunks are merged. Each merge is split into equal parts of the output at the
+	// positions found by DS_MergeCoRank, so that there is always one part per chunk to do in parallel.
+	for (intptr_t width = 1; width < num_chunks; width *= 2)
+	{
+		run_in_parallel([&](intptr_t part) {
+			intptr_t run = part / (width * 2);
+			intptr_t part_in_run = part % (width * 2);
+
+			intptr_t a_start = chunk_start(run * width * 2), b_start = chunk_start(run * width * 2 + width);
+			intptr_t b_end = chunk_start(run * width * 2 + width * 2);
+			const T* a = src + a_start;
+			const T* b = src + b_start;
+			intptr_t a_size = b_start - a_start, b_size = b_end - b_start;
+
+			intptr_t k_begin = (a_size + b_size) * part_in_run / (width * 2);
+			intptr_t k_end = (a_size + b_size) * (part_in_run + 1) / (width * 2);
+			intptr_t i = DS_MergeCoRank(k_begin, a, a_size, b, b_size, key);
+			intptr_t i_end = DS_MergeCoRank(k_end, a, a_size, b, b_size, key);
+			intptr_t j = k_begin - i, j_end = k_end - i_end;
+
+			T* out = dst + a_start + k_begin;
+			while (i < i_end && j < j_end)
+			{
+				if (key(b[j]) < key(a[i])) *out++ = b[j++];
+				else *out++ = a[i++];
+			}
+			while (i < i_end) *out++ = a[i++];
+			while (j < j_end) *out++ = b[j++];
+		});
+
+		T* swap = src; src = dst; dst = swap;
+	}
+
+	if (src != elements.Data)
+	{
+		for (intptr_t i = 0; i < elements.Size; i++)
+			elements.Data[i] = src[i];
+	}
+	allocator->MemFree(temp);
+}
+
+template<typename T>
+inline void DS_SPSCQueue<T>::Init(size_t capacity, DS_Allocator* allocator)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "DS_SPSCQueue requires a trivially copyable type");
+	DS_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0); // capacity must be a power of two!
+
+	Allocator = allocator ? allocator : DS_HeapAllocator();
+	Data = (T*)Allocator->MemAlloc(capacity * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	Mask = capacity - 1;
+	Head.store(0, std::memory_order_relaxed);
+	Tail.store(0, std::memory_order_relaxed);
+	CachedHead = 0;
+	CachedTail = 0;
+}
+
+template<typename T>
+inline void DS_SPSCQueue<T>::Deinit()
+{
+	Allocator->MemFree(Data);
+#ifndef DS_NO_DEBUG_CHECKS
+	Data = NULL;
+#endif
+}
+
+template<typename T>
+inline bool DS_SPSCQueue<T>::Push(const T& value)
+{
+	size_t tail = Tail.load(std::memory_order_relaxed);
+	if (tail - CachedHead > Mask)
+	{
+		CachedHead = Head.load(std::memory_order_acquire);
+		if (tail - CachedHead > Mask)
+			return false;
+	}
+
+	Data[tail & Mask] = value;
+	Tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T>
+inline bool DS_SPSCQueue<T>::Pop(T* out_value)
+{
+	size_t head = Head.load(std::memory_order_relaxed);
+	if (head == CachedTail)
+	{
+		CachedTail = Tail.load(std::memory_order_acquire);
+		if (head == CachedTail)
+			return false;
+	}
+
+	*out_value = Data[head & Mask];
+	Head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T>
+inline void DS_MPMCQueue<T>::Init(size_t capacity, DS_Allocator* allocator)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "DS_MPMCQueue requires a trivially copyable type");
+	DS_ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0); // capacity must be a power of two!
+
+	Allocator = allocator ? allocator : DS_HeapAllocator();
+	Cells = (DS_MPMCQueueCell<T>*)Allocator->MemAlloc(capacity * sizeof(DS_MPMCQueueCell<T>), DS_CACHE_LINE_SIZE);
+	for (size_t i = 0; i < capacity; i++)
+		new (&Cells[i].Sequence) std::atomic<size_t>(i);
+
+	Mask = capacity - 1;
+	EnqueuePos.store(0, std::memory_order_relaxed);
+	DequeuePos.store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline void DS_MPMCQueue<T>::Deinit()
+{
+	Allocator->MemFree(Cells);
+#ifndef DS_NO_DEBUG_CHECKS
+	Cells = NULL;
+#endif
+}
+
+template<typename T>
+inline bool DS_MPMCQueue<T>::Push(const T& value)
+{
+	size_t pos = EnqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		DS_MPMCQueueCell<T>* cell = &Cells[pos & Mask];
+		size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0)
+		{
+			// The cell is free for this lap. Claim it, or retry with the updated position if another producer got there first.
+			if (EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell->Value = value;
+				cell->Sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+			return false; // The cell still holds a value from the previous lap, so the queue is full
+		else
+			pos = EnqueuePos.load(std::memory_order_relaxed);
+	}
+}
+
+template<typename T>
+inline bool DS_MPMCQueue<T>::Pop(T* out_value)
+{
+	size_t pos = DequeuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		DS_MPMCQueueCell<T>* cell = &Cells[pos & Mask];
+		size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+		if (diff == 0)
+		{
+			if (DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				*out_value = cell->Value;
+				cell->Sequence.store(pos + Mask + 1, std::memory_order_release); // Free the cell for the next lap
+				return true;
+			}
+		}
+		else if (diff < 0)
+			return false; // Nothing has been written to the cell for this lap yet, so the queue is empty
+		else
+			pos = DequeuePos.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,1093 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+
+#include "ds/ds.h"
+
+#include "win32_utils.h"
+#include "evaluator.h"
+
+// The python side of a worker process. Blocks are sent to the worker's stdin as a little-endian 64-bit size followed by the
+// UTF-8 python code, and the result is written back to stdout in the same format. Everything the block prints (including
+// errors) becomes its result, like it would when running the code with `py` directly. Once started up, the worker sends
+// the byte 'R' followed by its 32-bit process ID, which isn't the ID of the process we start if it's the `py` launcher.
+//
+// The protocol runs over private duplicates of the stdin and stdout pipes, so that blocks can't read or write it. File descriptor 0
+// is replaced with the null device, and while a block runs, file descriptors 1 and 2 point to a temporary file. Output that doesn't
+// go through sys.stdout, e.g. from os.system or from C extensions, is collected there and appended to the result.
+//
+// Small blocks can be sent as a batch, to save round trips: the size has the highest bit set, and its lower bits are the number
+// of blocks, each of which follows as a size and the code. Each result is written back as soon as its block has been evaluated,
+// as its size, the wall time and CPU time of the block in microseconds (64 bits each) and the result, so that the results of the
+// blocks before one that makes the process exit aren't lost.
+//
+// The script is imported as a module rather than run as the main script, so that python caches its bytecode.
+// With the fast startup profile, python is started without `site` (-S). A finder at the end of sys.meta_path runs `site` the first
+// time an import isn't found otherwise, and then retries only that lookup, so the block that imports a package isn't run again.
+//
+// So that the result of a block doesn't depend on which worker evaluated it, the frames of the script are left out of tracebacks,
+// and the working directory is restored after each block. Tracebacks always start with the "Traceback" line, even for syntax
+// errors, which is how PyExpand recognizes failed blocks.
+static const char WORKER_SCRIPT[] = R"(import sys, os, io, time, tempfile, traceback
+stdin, stdout = os.fdopen(os.dup(0), 'rb'), os.fdopen(os.dup(1), 'wb')
+stderr_fd, null_fd = os.dup(2), os.open(os.devnull, os.O_RDWR)
+os.dup2(null_fd, 0)
+os.dup2(null_fd, 1)
+capture = tempfile.TemporaryFile()
+cwd = os.getcwd()
+
+def print_exception(e):
+    tb = e.__traceback__
+    while tb and tb.tb_frame.f_code.co_filename == __file__:
+        tb = tb.tb_next
+    if tb is None:
+        print('Traceback (most recent call last):')
+    traceback.print_exception(type(e), e, tb)
+
+class LazySiteFinder:
+    @classmethod
+    def find_spec(cls, name, path=None, target=None):
+        sys.meta_path.remove(cls)
+        import site
+        site.main()
+        for finder in sys.meta_path:
+            find_spec = getattr(finder, 'find_spec', None)
+            spec = find_spec(name, path, target) if find_spec else None
+            if spec:
+                return spec
+        return None
+
+if sys.flags.no_site:
+    sys.meta_path.append(LazySiteFinder)
+
+def restore_cwd():
+    try:
+        os.chdir(cwd)
+    except OSError:
+        pass
+
+def restore_output():
+    sys.stdout, sys.stderr = sys.__stdout__, sys.__stderr__
+    for f in sys.stdout, sys.stderr:
+        try:
+            f.flush()
+        except Exception:
+            pass
+    os.dup2(null_fd, 1)
+    os.dup2(stderr_fd, 2)
+
+def run(code):
+    output = io.StringIO()
+    capture.seek(0)
+    capture.truncate()
+    os.dup2(capture.fileno(), 1)
+    os.dup2(capture.fileno(), 2)
+    sys.stdout = sys.stderr = output
+    try:
+        exec(code, {'__name__': '__main__'})
+    except BaseException as e:
+        print_exception(e)
+    restore_output()
+    restore_cwd()
+    capture.seek(0)
+    return output.getvalue() + capture.read().decode('utf-8', 'replace').replace('\r\n', '\n')
+
+stdout.write(b'R' + os.getpid().to_bytes(4, 'little'))
+stdout.flush()
+while True:
+    header = stdin.read(8)
+    if len(header) < 8:
+        break
+    size = int.from_bytes(header, 'little')
+    if size >> 63:
+        codes = [stdin.read(int.from_bytes(stdin.read(8), 'little')).decode('utf-8') for i in range(size & ~(1 << 63))]
+        for code in codes:
+            wall_time, cpu_time = time.perf_counter_ns(), time.process_time_ns()
+            result = run(code).replace('\n', os.linesep).encode('utf-8')
+            wall_time, cpu_time = time.perf_counter_ns() - wall_time, time.process_time_ns() - cpu_time
+            stdout.write(b''.join([len(result).to_bytes(8, 'little'), (wall_time // 1000).to_bytes(8, 'little'), (cpu_time // 1000).to_bytes(8, 'little'), result]))
+            stdout.flush()
+    else:
+        code = stdin.read(size).decode('utf-8')
+        result = run(code).replace('\n', os.linesep).encode('utf-8')
+        stdout.write(len(result).to_bytes(8, 'little') + result)
+        stdout.flush()
+)";
+
+struct Worker
+{
+	OS_Process Process;
+	uint32_t InterpreterProcessID; // Valid once `Ready` is true
+	bool Ready;
+	int BlocksServed;
+	uint64_t StartTime;
+};
+
+struct SpeculativeBlock;
+
+// Each worker process is driven by its own thread. Python may hold on to memory from blocks that build huge data structures,
+// so the process is recycled after it has served too many blocks or grown too large. The replacement is started in the background
+// and the old process keeps serving blocks until the replacement is ready, so recycling never waits for python to start.
+struct WorkerThread
+{
+	Evaluator* Owner;
+	OS_Thread Thread;
+	Worker Current;
+	Worker Replacement; // Valid if HasReplacement is true
+	bool HasReplacement;
+
+	// The jobs that the thread is evaluating, with the arenas for their results. Sized for the largest batch.
+	EvalJob** BatchJobs;
+	DS_Arena** BatchArenas;
+	SpeculativeBlock** BatchBlocks; // If the jobs are speculative
+};
+
+// A block that is evaluated speculatively. It owns its code and result, so it can outlive the EvaluateBlocks call that
+// eventually uses it (or not).
+enum SpeculationState { SpeculationState_Queued, SpeculationState_Running, SpeculationState_Done };
+
+struct SpeculativeBlock
+{
+	uint64_t Key; // DS_Hash64 of the code
+	uint64_t Group;
+	SpeculationState State;
+	bool Claimed;   // An EvaluateBlocks call is waiting for the result
+	bool Cancelled; // Cancelled while running. The worker thread frees the block once it's done.
+	DS_Arena Arena; // For the code and the result
+	EvalJob Job;
+};
+
+struct CachedResult
+{
+	DS_StringView Code;
+	DS_StringView Result;
+};
+
+struct Evaluator
+{
+	EvaluatorOptions Options;
+	DS_String WorkerCommand;
+	DS_Arena Arena; // For the WorkerThread structs and strings
+
+	// Results of the blocks evaluated so far, by DS_Hash64 of the code, so that identical blocks are evaluated only once per run.
+	// Only used with the CoalesceBlocks option. The cache is read without the mutex, but results are only added to it, and cloned
+	// into ResultCacheArena, with the mutex locked.
+	DS_ConcurrentMap<uint64_t, CachedResult> ResultCache;
+	DS_Arena ResultCacheArena;
+
+	OS_Mutex Mutex; // Protects everything below
+	OS_ConditionVariable WorkAvailable; // Signaled when jobs are queued or the evaluator is stopping
+	OS_ConditionVariable WorkDone;      // Signaled when a job finishes or a worker thread exits
+
+	DS_Array<WorkerThread*> Threads; // All threads that were ever started, joined in StopEvaluator
+	int NumStartingWorkers;
+	bool Stopping;
+
+	EvalJob** Queue;
+	intptr_t QueueSize;
+	intptr_t QueueHead;
+	intptr_t JobsRemaining;
+	DS_Arena* ResultArena;
+
+	// Queued, running and finished speculative blocks, in the order they were queued. Speculation is bounded by how far ahead
+	// the caller looks, so linear searches are fine.
+	DS_Array<SpeculativeBlock*> Speculation;
+
+	EvaluatorStats Stats;
+};
+
+static void RecordWorkerStartFailure(Evaluator* evaluator)
+{
+	OS_MutexLock(&evaluator->Mutex);
+	evaluator->Stats.WorkerStartFailures += 1;
+	OS_MutexUnlock(&evaluator->Mutex);
+}
+
+static bool StartWorker(Evaluator* evaluator, Worker* out_worker)
+{
+	*out_worker = {};
+	out_worker->StartTime = OS_GetTimeMicroseconds();
+	if (!OS_StartProcess(evaluator->WorkerCommand, &out_worker->Process))
+	{
+		RecordWorkerStartFailure(evaluator);
+		return false;
+	}
+
+	// The CPU time limit is set separately for each block.
+	if (evaluator->Options.MemoryLimitBytes > 0)
+		OS_SetProcessLimits(&out_worker->Process, evaluator->Options.MemoryLimitBytes, 0);
+	return true;
+}
+
+static void RecordWorkerStartup(Evaluator* evaluator, Worker* worker)
+{
+	uint64_t startup_us = OS_GetTimeMicroseconds() - worker->StartTime;
+
+	OS_MutexLock(&evaluator->Mutex);
+	EvaluatorStats* stats = &evaluator->Stats;
+	if (stats->WorkerStartups == 0 || startup_us < stats->MinWorkerStartupUs) stats->MinWorkerStartupUs = startup_us;
+	if (startup_us > stats->MaxWorkerStartupUs) stats->MaxWorkerStartupUs = startup_us;
+	stats->TotalWorkerStartupUs += startup_us;
+	stats->WorkerStartups += 1;
+	OS_MutexUnlock(&evaluator->Mutex);
+}
+
+static bool WaitUntilWorkerReady(Evaluator* evaluator, Worker* worker)
+{
+	if (!worker->Ready)
+	{
+		uint8_t message[5];
+		if (!OS_ReadFromProcess(&worker->Process, message, sizeof(message)) || message[0] != 'R')
+		{
+			RecordWorkerStartFailure(evaluator);
+			return false;
+		}
+
+		memcpy(&worker->InterpreterProcessID, message + 1, 4);
+		worker->Ready = true;
+		RecordWorkerStartup(evaluator, worker);
+	}
+	return true;
+}
+
+static bool WorkerNeedsRecycling(const EvaluatorOptions& options, Worker* worker, const OS_ProcessUsage& usage)
+{
+	if (options.RecycleAfterBlocks > 0 && worker->BlocksServed >= options.RecycleAfterBlocks)
+		return true;
+
+	if (options.RecycleAfterBytes > 0 && usage.WorkingSet >= options.RecycleAfterBytes)
+		return true;
+
+	return false;
+}
+
+// Switches over to the replacement worker process once it has started up. If the replacement died while starting up, the current
+// worker keeps serving blocks, and another replacement is started when it needs recycling again.
+static void SwapInReplacementIfReady(WorkerThread* thread)
+{
+	Evaluator* evaluator = thread->Owner;
+	if (!thread->HasReplacement)
+		return;
+
+	bool has_output;
+	if (!OS_PeekProcessOutput(&thread->Replacement.Process, &has_output))
+	{
+		OS_CloseProcess(&thread->Replacement.Process, false);
+		thread->HasReplacement = false;
+		RecordWorkerStartFailure(evaluator);
+	}
+	else if (has_output)
+	{
+		OS_CloseProcess(&thread->Current.Process, false);
+		thread->Current = thread->Replacement;
+		thread->HasReplacement = false;
+		WaitUntilWorkerReady(evaluator, &thread->Current); // Doesn't block, the ready message is already there
+
+		OS_MutexLock(&evaluator->Mutex);
+		evaluator->Stats.WorkersRecycled += 1;
+		OS_MutexUnlock(&evaluator->Mutex);
+	}
+}
+
+// The current worker of the thread must be ready. Returns false if the worker process died while evaluating the job.
+static bool EvaluateOnWorker(WorkerThread* thread, EvalJob* job, DS_Arena* result_arena)
+{
+	Evaluator* evaluator = thread->Owner;
+	Worker* worker = &thread->Current;
+
+	OS_ProcessUsage usage_before = {};
+	bool has_usage_before = OS_GetProcessUsage(worker->InterpreterProcessID, &usage_before);
+
+	// The CPU time limit of a process is for its whole lifetime, so we move it forward before each block.
+	if (evaluator->Options.CPUTimeLimitUs > 0 && has_usage_before)
+		OS_SetProcessLimits(&worker->Process, evaluator->Options.MemoryLimitBytes, usage_before.UserTimeUs + evaluator->Options.CPUTimeLimitUs);
+
+	uint64_t start_time = OS_GetTimeMicroseconds();
+
+	uint64_t code_size = job->Code.Size;
+	if (!OS_WriteToProcess(&worker->Process, &code_size, sizeof(code_size))) return false;
+	if (!OS_WriteToProcess(&worker->Process, job->Code.Data, job->Code.Size)) return false;
+
+	uint64_t result_size;
+	if (!OS_ReadFromProcess(&worker->Process, &result_size, sizeof(result_size))) return false;
+
+	OS_MutexLock(&evaluator->Mutex);
+	char* result_data = result_arena->PushUninitialized(result_size);
+	OS_MutexUnlock(&evaluator->Mutex);
+
+	if (!OS_ReadFromProcess(&worker->Process, result_data, result_size)) return false;
+
+	job->Result = DS_StringView(result_data, (intptr_t)result_size);
+	job->WallTimeUs = OS_GetTimeMicroseconds() - start_time;
+	worker->BlocksServed += 1;
+
+	OS_ProcessUsage usage_after = {};
+	if (OS_GetProcessUsage(worker->InterpreterProcessID, &usage_after))
+	{
+		if (has_usage_before)
+		{
+			job->CPUTimeUs = (usage_after.UserTimeUs + usage_after.KernelTimeUs) - (usage_before.UserTimeUs + usage_before.KernelTimeUs);
+			job->PeakWorkingSetIncrease = usage_after.PeakWorkingSet - usage_before.PeakWorkingSet;
+		}
+		job->PeakWorkingSet = usage_after.PeakWorkingSet;
+	}
+
+	if (!thread->HasReplacement && WorkerNeedsRecycling(evaluator->Options, worker, usage_after))
+		thread->HasReplacement = StartWorker(evaluator, &thread->Replacement);
+
+	return true;
+}
+
+// Like EvaluateOnWorker, but evaluates several jobs in one round trip. The worker process measures the wall time and CPU time of
+// each job, but the peak working set is only known after the whole batch, so PeakWorkingSetIncrease is left at 0. `out_num_done` is set to the number of jobs whose results
+// have been received, which is less than the number of jobs if the worker process exits during the batch.
+static bool EvaluateBatchOnWorker(WorkerThread* thread, DS_Slice<EvalJob*> jobs, DS_Slice<DS_Arena*> result_arenas, intptr_t* out_num_done)
+{
+	*out_num_done = 0;
+	Evaluator* evaluator = thread->Owner;
+	Worker* worker = &thread->Current;
+
+	DS_ScopedArena<4096> temp;
+	DS_DynamicString message(&temp);
+	uint64_t header = (1ull << 63) | (uint64_t)jobs.Size;
+	message.Add(DS_StringView((char*)&header, sizeof(header)));
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		uint64_t code_size = jobs[i]->Code.Size;
+		message.Add(DS_StringView((char*)&code_size, sizeof(code_size)));
+		message.Add(jobs[i]->Code);
+	}
+	if (!OS_WriteToProcess(&worker->Process, message.Data, message.Size)) return false;
+
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		uint64_t result_header[3]; // Size, wall time and CPU time
+		if (!OS_ReadFromProcess(&worker->Process, result_header, sizeof(result_header))) return false;
+
+		OS_MutexLock(&evaluator->Mutex);
+		char* result_data = result_arenas[i]->PushUninitialized(result_header[0]);
+		OS_MutexUnlock(&evaluator->Mutex);
+
+		if (!OS_ReadFromProcess(&worker->Process, result_data, result_header[0])) return false;
+
+		jobs[i]->Result = DS_StringView(result_data, (intptr_t)result_header[0]);
+		jobs[i]->WallTimeUs = result_header[1];
+		jobs[i]->CPUTimeUs = result_header[2];
+		jobs[i]->PeakWorkingSetIncrease = 0;
+		worker->BlocksServed += 1;
+		*out_num_done = i + 1;
+	}
+
+	OS_ProcessUsage usage_after = {};
+	if (OS_GetProcessUsage(worker->InterpreterProcessID, &usage_after))
+	{
+		for (intptr_t i = 0; i < jobs.Size; i++)
+			jobs[i]->PeakWorkingSet = usage_after.PeakWorkingSet;
+	}
+
+	if (!thread->HasReplacement && WorkerNeedsRecycling(evaluator->Options, worker, usage_after))
+		thread->HasReplacement = StartWorker(evaluator, &thread->Replacement);
+
+	return true;
+}
+
+static void RecordWaitTime(EvaluatorStats* stats, uint64_t wait_us)
+{
+	int bucket = 0;
+	for (uint64_t limit = 1000; bucket < EVALUATOR_WAIT_HISTOGRAM_BUCKETS - 1 && wait_us >= limit; limit *= 10)
+		bucket += 1;
+	stats->WaitHistogram[bucket] += 1;
+}
+
+// Evaluates jobs on the current worker of the thread, in one round trip if there are several. If the worker process has died or
+// never started, a new one is started first. `worker_ok` tracks whether the current worker process is usable.
+static void RunJobs(WorkerThread* thread, DS_Slice<EvalJob*> jobs, DS_Slice<DS_Arena*> result_arenas, bool* worker_ok)
+{
+	Evaluator* evaluator = thread->Owner;
+
+	SwapInReplacementIfReady(thread);
+	if (!*worker_ok)
+	{
+		OS_CloseProcess(&thread->Current.Process, false);
+		*worker_ok = StartWorker(evaluator, &thread->Current);
+	}
+	*worker_ok = *worker_ok && WaitUntilWorkerReady(evaluator, &thread->Current);
+	for (intptr_t i = 0; i < jobs.Size; i++)
+		jobs[i]->Ok = *worker_ok;
+
+	intptr_t num_done = 0;
+	if (*worker_ok && !(jobs.Size == 1 ? EvaluateOnWorker(thread, jobs[0], result_arenas[0]) : EvaluateBatchOnWorker(thread, jobs, result_arenas, &num_done)))
+	{
+		*worker_ok = false;
+
+		// The results of a batch arrive one block at a time, so the blocks before the one that was being evaluated when the worker
+		// process exited keep their results. That block may have failed only because of what earlier blocks left behind, so it's
+		// evaluated again on its own, with a new worker process, and fails if that exits too. The rest of the batch follows.
+		if (jobs.Size > 1)
+		{
+			RunJobs(thread, DS_Slice<EvalJob*>(&jobs[num_done], 1), DS_Slice<DS_Arena*>(&result_arenas[num_done], 1), worker_ok);
+			if (num_done + 1 < jobs.Size)
+			{
+				DS_Slice<EvalJob*> rest(&jobs[num_done + 1], jobs.Size - num_done - 1);
+				RunJobs(thread, rest, DS_Slice<DS_Arena*>(&result_arenas[num_done + 1], rest.Size), worker_ok);
+			}
+			return;
+		}
+
+		jobs[0]->Result = evaluator->Options.MemoryLimitBytes > 0 || evaluator->Options.CPUTimeLimitUs > 0 ?
+			DS_StringView("Error: The python worker process exited while evaluating this block. Did it exceed the CPU time or memory limit?") :
+			DS_StringView("Error: The python worker process exited while evaluating this block.");
+	}
+}
+
+static void FreeSpeculativeBlock(SpeculativeBlock* block)
+{
+	block->Arena.Deinit();
+	DS_HeapAllocator()->MemFree(block);
+}
+
+static bool IsSmallJob(Evaluator* evaluator, const EvalJob* job)
+{
+	return job->Code.Size <= (intptr_t)evaluator->Options.MaxBatchedCodeBytes;
+}
+
+// The mutex must be locked. Returns how many small jobs a worker may take at once when `num_queued` jobs are waiting. A batch is
+// at most an equal share of the queued jobs, so that the other workers get some too. The CPU time limit is for a single block,
+// and so is the measured peak working set increase, so they need a round trip per block.
+static intptr_t GetBatchLimit(Evaluator* evaluator, intptr_t num_queued)
+{
+	const EvaluatorOptions& options = evaluator->Options;
+	if (options.MaxBatchSize <= 1 || options.CPUTimeLimitUs > 0 || options.MeasureEachBlock)
+		return 1;
+
+	intptr_t num_workers = evaluator->Stats.NumWorkers > 0 ? evaluator->Stats.NumWorkers : 1;
+	intptr_t limit = (num_queued + num_workers - 1) / num_workers;
+	return limit < options.MaxBatchSize ? limit : options.MaxBatchSize;
+}
+
+// The mutex must be locked. Takes the next queued job into the batch of the thread, and if it's small, the small jobs queued right
+// after it too. Returns the number of jobs taken.
+static intptr_t TakeQueuedJobs(WorkerThread* thread)
+{
+	Evaluator* evaluator = thread->Owner;
+	intptr_t batch_limit = GetBatchLimit(evaluator, evaluator->QueueSize - evaluator->QueueHead);
+	uint64_t now = OS_GetTimeMicroseconds();
+
+	intptr_t batch_size = 0;
+	do
+	{
+		EvalJob* job = evaluator->Queue[evaluator->QueueHead++];
+		RecordWaitTime(&evaluator->Stats, now - job->QueuedTime);
+		thread->BatchJobs[batch_size] = job;
+		thread->BatchArenas[batch_size] = evaluator->ResultArena;
+		batch_size += 1;
+	} while (batch_size < batch_limit && evaluator->QueueHead < evaluator->QueueSize &&
+		IsSmallJob(evaluator, thread->BatchJobs[0]) && IsSmallJob(evaluator, evaluator->Queue[evaluator->QueueHead]));
+
+	evaluator->Stats.QueueDepth = evaluator->QueueSize - evaluator->QueueHead;
+	return batch_size;
+}
+
+// The mutex must be locked. Like TakeQueuedJobs, but for speculative blocks. Returns 0 if there's no queued speculative block.
+static intptr_t TakeSpeculativeBlocks(WorkerThread* thread)
+{
+	Evaluator* evaluator = thread->Owner;
+	intptr_t num_queued = 0;
+	for (int i = 0; i < evaluator->Speculation.Size; i++)
+		num_queued += evaluator->Speculation[i]->State == SpeculationState_Queued;
+	if (num_queued == 0)
+		return 0;
+
+	intptr_t batch_limit = GetBatchLimit(evaluator, num_queued);
+	intptr_t batch_size = 0;
+	for (int i = 0; i < evaluator->Speculation.Size && batch_size < batch_limit; i++)
+	{
+		SpeculativeBlock* block = evaluator->Speculation[i];
+		if (block->State != SpeculationState_Queued)
+			continue;
+		if (batch_size > 0 && !(IsSmallJob(evaluator, thread->BatchJobs[0]) && IsSmallJob(evaluator, &block->Job)))
+			break;
+
+		block->State = SpeculationState_Running;
+		thread->BatchBlocks[batch_size] = block;
+		thread->BatchJobs[batch_size] = &block->Job;
+		thread->BatchArenas[batch_size] = &block->Arena;
+		batch_size += 1;
+	}
+	return batch_size;
+}
+
+// The mutex must be locked.
+static void RecordBatch(EvaluatorStats* stats, intptr_t batch_size)
+{
+	stats->BlocksEvaluated += batch_size;
+	if (batch_size > 1)
+	{
+		stats->Batches += 1;
+		stats->BlocksBatched += batch_size;
+	}
+}
+
+static void WorkerThreadProc(void* arg)
+{
+	WorkerThread* thread = (WorkerThread*)arg;
+	Evaluator* evaluator = thread->Owner;
+
+	bool worker_ok = StartWorker(evaluator, &thread->Current) && WaitUntilWorkerReady(evaluator, &thread->Current);
+
+	OS_MutexLock(&evaluator->Mutex);
+	evaluator->NumStartingWorkers -= 1;
+
+	uint64_t idle_since = OS_GetTimeMicroseconds();
+	for (;;)
+	{
+		if (evaluator->Stopping)
+			break;
+
+		if (evaluator->QueueHead < evaluator->QueueSize)
+		{
+			intptr_t batch_size = TakeQueuedJobs(thread);
+			OS_MutexUnlock(&evaluator->Mutex);
+
+			RunJobs(thread, DS_Slice<EvalJob*>(thread->BatchJobs, batch_size), DS_Slice<DS_Arena*>(thread->BatchArenas, batch_size), &worker_ok);
+
+			OS_MutexLock(&evaluator->Mutex);
+			evaluator->JobsRemaining -= batch_size;
+			RecordBatch(&evaluator->Stats, batch_size);
+			OS_ConditionVariableBroadcast(&evaluator->WorkDone);
+			idle_since = OS_GetTimeMicroseconds();
+			continue;
+		}
+
+		// Speculative blocks have lower priority, so they're only taken when the queue is empty.
+		if (intptr_t batch_size = TakeSpeculativeBlocks(thread))
+		{
+			OS_MutexUnlock(&evaluator->Mutex);
+
+			RunJobs(thread, DS_Slice<EvalJob*>(thread->BatchJobs, batch_size), DS_Slice<DS_Arena*>(thread->BatchArenas, batch_size), &worker_ok);
+
+			OS_MutexLock(&evaluator->Mutex);
+			for (intptr_t i = 0; i < batch_size; i++)
+			{
+				SpeculativeBlock* block = thread->BatchBlocks[i];
+				block->State = SpeculationState_Done;
+				if (block->Cancelled)
+					FreeSpeculativeBlock(block);
+			}
+			RecordBatch(&evaluator->Stats, batch_size);
+			evaluator->Stats.SpeculativeBlocksEvaluated += batch_size;
+			OS_ConditionVariableBroadcast(&evaluator->WorkDone);
+			idle_since = OS_GetTimeMicroseconds();
+			continue;
+		}
+
+		// Scale down: exit if we've been idle for long enough, unless we're the last worker.
+		uint64_t idle_ms = (OS_GetTimeMicroseconds() - idle_since) / 1000;
+		if (idle_ms >= evaluator->Options.IdleTimeoutMs && evaluator->Stats.NumWorkers > 1)
+		{
+			evaluator->Stats.WorkersRetired += 1;
+			break;
+		}
+
+		uint32_t timeout_ms = idle_ms < evaluator->Options.IdleTimeoutMs ? evaluator->Options.IdleTimeoutMs - (uint32_t)idle_ms : evaluator->Options.IdleTimeoutMs;
+		OS_ConditionVariableWait(&evaluator->WorkAvailable, &evaluator->Mutex, timeout_ms);
+	}
+
+	evaluator->Stats.NumWorkers -= 1;
+	OS_ConditionVariableBroadcast(&evaluator->WorkDone);
+	OS_MutexUnlock(&evaluator->Mutex);
+
+	// We're on a background thread, so we can afford to wait for the processes to exit. This way, the worker script file
+	// isn't in use anymore when StopEvaluator deletes it.
+	OS_CloseProcess(&thread->Current.Process, true);
+	if (thread->HasReplacement)
+		OS_CloseProcess(&thread->Replacement.Process, true);
+}
+
+// The mutex must be locked.
+static void StartWorkerThread(Evaluator* evaluator)
+{
+	WorkerThread* thread = evaluator->Arena.New(WorkerThread{});
+	thread->Owner = evaluator;
+	int max_batch_size = evaluator->Options.MaxBatchSize > 1 ? evaluator->Options.MaxBatchSize : 1;
+	thread->BatchJobs = evaluator->Arena.Alloc<EvalJob*>(max_batch_size);
+	thread->BatchArenas = evaluator->Arena.Alloc<DS_Arena*>(max_batch_size);
+	thread->BatchBlocks = evaluator->Arena.Alloc<SpeculativeBlock*>(max_batch_size);
+	if (!OS_StartThread(&thread->Thread, WorkerThreadProc, thread))
+		return;
+
+	evaluator->Threads.Add(thread);
+	evaluator->NumStartingWorkers += 1;
+	evaluator->Stats.NumWorkers += 1;
+	evaluator->Stats.WorkersStarted += 1;
+	if (evaluator->Stats.NumWorkers > evaluator->Stats.PeakWorkers)
+		evaluator->Stats.PeakWorkers = evaluator->Stats.NumWorkers;
+}
+
+static uint64_t GetFileStamp(const char* filepath)
+{
+	uint64_t stamp[2];
+	if (!OS_GetFileStamp(filepath, &stamp[0], &stamp[1]))
+		return 0;
+	return DS_Hash64(stamp, sizeof(stamp));
+}
+
+// Asking the `py` launcher for the default interpreter means starting two processes, the launcher and python, so the path
+// of the interpreter is cached along with its version and a stamp of the executable file (a hash of its size and modification time).
+// Returns the path to the python executable.
+static bool ResolveInterpreter(DS_Arena* arena, DS_StringView cache_directory, DS_String* out_interpreter)
+{
+	DS_DynamicString cache_filepath(arena);
+	cache_filepath.Addf("%.*s/interpreter.txt", DS_StrVArg(cache_directory));
+
+	// The cache file has three lines: the path to the interpreter, its version and the stamp in hex.
+	DS_StringView cache_data;
+	if (OS_ReadEntireFile(arena, cache_filepath.CStr(), &cache_data))
+	{
+		DS_String interpreter = cache_data.Split("\n").Clone(arena);
+		cache_data.Split("\n"); // Skip the version, it's only there for the user
+		DS_StringView stamp_str = cache_data.Split("\n");
+
+		uint64_t stamp = 0;
+		for (intptr_t i = 0; i < stamp_str.Size; i++)
+			stamp = (stamp << 4) | (uint64_t)(stamp_str.Data[i] <= '9' ? stamp_str.Data[i] - '0' : stamp_str.Data[i] - 'a' + 10);
+
+		if (interpreter.Size > 0 && stamp != 0 && stamp == GetFileStamp(interpreter.CStr()))
+		{
+			*out_interpreter = interpreter;
+			return true;
+		}
+	}
+
+	struct PrintCallback {
+		OS_RunProcessPrintCallback Base;
+		DS_DynamicString Result;
+	} print_callback;
+	print_callback.Result.Init(arena);
+	print_callback.Base.Print = [](OS_RunProcessPrintCallback* self, const char* message) {
+		((PrintCallback*)self)->Result.Addf("%s", message);
+	};
+
+	uint32_t exit_code;
+	DS_DynamicString command(arena);
+	command.Add("py -c \"import sys; print(sys.executable); print(sys.version.split()[0])\"");
+	if (!OS_RunConsoleCommand(command, true, &exit_code, &print_callback.Base) || exit_code != 0)
+		return false;
+
+	DS_StringView output = print_callback.Result;
+	DS_StringView lines[2];
+	for (int i = 0; i < 2; i++)
+	{
+		lines[i] = output.Split("\n");
+		if (lines[i].Size > 0 && lines[i].Data[lines[i].Size - 1] == '\r')
+			lines[i].Size -= 1;
+	}
+	DS_String interpreter = lines[0].Clone(arena);
+	DS_StringView version = lines[1];
+	uint64_t stamp = GetFileStamp(interpreter.CStr());
+	if (stamp == 0)
+		return false;
+
+	printf("Using python %.*s at '%s'\n", (int)version.Size, version.Data, interpreter.CStr());
+
+	DS_DynamicString new_cache_data(arena);
+	new_cache_data.Addf("%s\n%.*s\n%016llx\n", interpreter.CStr(), DS_StrVArg(version), (unsigned long long)stamp);
+	OS_WriteFileAtomically(cache_filepath.CStr(), new_cache_data); // If this fails, we just resolve the interpreter again next time
+
+	*out_interpreter = interpreter;
+	return true;
+}
+
+Evaluator* StartEvaluator(const EvaluatorOptions& options)
+{
+	// The result cache contains mutexes, so the evaluator is constructed in place rather than assigned
+	void* evaluator_memory = DS_HeapAllocator()->MemAlloc(sizeof(Evaluator), alignof(Evaluator));
+	Evaluator* evaluator = new (evaluator_memory) Evaluator();
+	evaluator->Options = options;
+	if (evaluator->Options.MaxWorkers < 1) evaluator->Options.MaxWorkers = 1;
+	evaluator->Arena.Init();
+	evaluator->Threads.Init(&evaluator->Arena);
+	evaluator->Speculation.Init(); // Blocks come and go during the whole run, so this lives on the heap
+	evaluator->ResultCacheArena.Init();
+	evaluator->ResultCache.Init();
+
+	DS_String cache_directory;
+	if (!OS_GetCacheDirectory(&evaluator->Arena, "PyExpand", &cache_directory))
+	{
+		printf("Failed to create the cache directory!\n");
+		evaluator->Arena.Deinit();
+		evaluator->~Evaluator();
+		DS_HeapAllocator()->MemFree(evaluator);
+		return NULL;
+	}
+
+	DS_String interpreter = DS_Str(options.Interpreter);
+	if (interpreter.Size == 0 && !ResolveInterpreter(&evaluator->Arena, cache_directory, &interpreter))
+	{
+		printf("Failed to call python. Do you have python installed?\n");
+		evaluator->Arena.Deinit();
+		evaluator->~Evaluator();
+		DS_HeapAllocator()->MemFree(evaluator);
+		return NULL;
+	}
+
+	// The worker script is named after its hash, so that it can be shared by all PyExpand processes and versions,
+	// and its cached bytecode stays valid.
+	DS_StringView script = WORKER_SCRIPT;
+	DS_InlineString<64> module_name;
+	module_name.Addf("pyexpand_worker_%016llx", (unsigned long long)DS_Hash64(script.Data, script.Size));
+
+	DS_DynamicString script_filepath(&evaluator->Arena);
+	script_filepath.Addf("%.*s/%s.py", DS_StrVArg(cache_directory), module_name.CStr());
+	if (GetFileStamp(script_filepath.CStr()) == 0 && !OS_WriteFileAtomically(script_filepath.CStr(), script))
+	{
+		printf("Failed to create the python worker script '%s'!\n", script_filepath.CStr());
+		evaluator->Arena.Deinit();
+		evaluator->~Evaluator();
+		DS_HeapAllocator()->MemFree(evaluator);
+		return NULL;
+	}
+
+	// The fast startup profile runs python without importing `site` (-S) until a block needs it, and ignores PYTHON* environment
+	// variables (-E). It doesn't use isolated mode (-I), since that also turns off the user site directory, so packages installed
+	// with `pip install --user` couldn't be found.
+	DS_DynamicString worker_command(&evaluator->Arena);
+	worker_command.Addf("\"%s\"%s -c \"import sys; sys.path.insert(0, sys.argv[1]); import %s\" \"%.*s\"", interpreter.CStr(),
+		options.FastStartup ? " -E -S" : "", module_name.CStr(), DS_StrVArg(cache_directory));
+	evaluator->WorkerCommand = worker_command;
+
+	// Start the first worker right away, so that python starts up while we read and parse the input file.
+	OS_MutexLock(&evaluator->Mutex);
+	StartWorkerThread(evaluator);
+	OS_MutexUnlock(&evaluator->Mutex);
+	return evaluator;
+}
+
+void StopEvaluator(Evaluator* evaluator)
+{
+	OS_MutexLock(&evaluator->Mutex);
+	evaluator->Stopping = true;
+	OS_ConditionVariableBroadcast(&evaluator->WorkAvailable);
+	OS_MutexUnlock(&evaluator->Mutex);
+
+	for (int i = 0; i < evaluator->Threads.Size; i++)
+		OS_JoinThread(&evaluator->Threads[i]->Thread);
+
+	for (int i = 0; i < evaluator->Speculation.Size; i++)
+		FreeSpeculativeBlock(evaluator->Speculation[i]);
+	evaluator->Speculation.Deinit();
+	evaluator->ResultCache.Deinit();
+	evaluator->ResultCacheArena.Deinit();
+
+	evaluator->Arena.Deinit();
+	evaluator->~Evaluator();
+	DS_HeapAllocator()->MemFree(evaluator);
+}
+
+static uint64_t BlockKey(DS_StringView code)
+{
+	uint64_t key = DS_Hash64(code.Data, code.Size);
+	return key != 0 ? key : 1;
+}
+
+// The mutex must be locked.
+static intptr_t FindSpeculativeBlock(Evaluator* evaluator, DS_StringView code, uint64_t key)
+{
+	for (intptr_t i = 0; i < evaluator->Speculation.Size; i++)
+	{
+		SpeculativeBlock* block = evaluator->Speculation[i];
+		if (block->Key == key && block->Job.Code == code)
+			return i;
+	}
+	return -1;
+}
+
+// The mutex must be locked. A running block is freed by its worker thread once it's done.
+static void RemoveSpeculativeBlock(Evaluator* evaluator, intptr_t index)
+{
+	SpeculativeBlock* block = evaluator->Speculation[index];
+	evaluator->Speculation.Remove(index);
+	if (block->State == SpeculationState_Running)
+		block->Cancelled = true;
+	else
+		FreeSpeculativeBlock(block);
+}
+
+void SpeculateBlocks(Evaluator* evaluator, uint64_t group, DS_Slice<DS_StringView> codes)
+{
+	// Speculative results are reused by their code alone, like cached results
+	if (!evaluator->Options.CoalesceBlocks)
+		return;
+
+	OS_MutexLock(&evaluator->Mutex);
+
+	// The source of the group has changed, so its blocks that aren't there anymore are cancelled.
+	for (intptr_t i = evaluator->Speculation.Size - 1; i >= 0; i--)
+	{
+		SpeculativeBlock* block = evaluator->Speculation[i];
+		if (block->Group != group || block->Claimed)
+			continue;
+
+		bool still_wanted = false;
+		for (intptr_t j = 0; j < codes.Size && !still_wanted; j++)
+			still_wanted = block->Job.Code == codes[j];
+
+		if (!still_wanted)
+		{
+			RemoveSpeculativeBlock(evaluator, i);
+			evaluator->Stats.SpeculativeDiscarded += 1;
+		}
+	}
+
+	bool added = false;
+	uint64_t now = OS_GetTimeMicroseconds();
+	for (intptr_t i = 0; i < codes.Size; i++)
+	{
+		uint64_t key = BlockKey(codes[i]);
+		CachedResult cached;
+		if (evaluator->ResultCache.Find(key, &cached) && cached.Code == codes[i])
+			continue;
+
+		intptr_t existing = FindSpeculativeBlock(evaluator, codes[i], key);
+		if (existing != -1)
+		{
+			evaluator->Speculation[existing]->Group = group;
+			continue;
+		}
+
+		SpeculativeBlock* block = (SpeculativeBlock*)DS_HeapAllocator()->MemAlloc(sizeof(SpeculativeBlock));
+		*block = {};
+		block->Key = key;
+		block->Group = group;
+		block->Arena.Init();
+		block->Job.Code = DS_StringView(block->Arena.Clone(codes[i].Data, codes[i].Size), codes[i].Size);
+		block->Job.QueuedTime = now;
+		evaluator->Speculation.Add(block);
+		added = true;
+	}
+
+	if (added)
+		OS_ConditionVariableBroadcast(&evaluator->WorkAvailable);
+	OS_MutexUnlock(&evaluator->Mutex);
+}
+
+bool EvaluateBlocks(Evaluator* evaluator, DS_Arena* arena, DS_Slice<EvalJob> jobs)
+{
+	// Hashing the code and looking up the result cache don't need the lock
+	uint64_t* keys = arena->Alloc<uint64_t>(jobs.Size);
+	CachedResult* cached_results = arena->Alloc<CachedResult>(jobs.Size);
+	bool* is_cached = arena->Alloc<bool>(jobs.Size);
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		keys[i] = BlockKey(jobs[i].Code);
+		is_cached[i] = evaluator->Options.CoalesceBlocks && evaluator->ResultCache.Find(keys[i], &cached_results[i]) &&
+			cached_results[i].Code == jobs[i].Code;
+	}
+
+	OS_MutexLock(&evaluator->Mutex);
+
+	// With CoalesceBlocks, a job whose code has already been evaluated in this run takes the cached result, and a job that is
+	// identical to an earlier job of this call attaches to it (the leader), so identical code is only evaluated once.
+	// Jobs whose code has been speculated on take the speculative result, or wait for it if it's being evaluated right now.
+	// If the speculative block hasn't started yet, it's cancelled and the job is queued normally, so it gets the higher priority.
+	EvalJob** queue = arena->Alloc<EvalJob*>(jobs.Size);
+	SpeculativeBlock** claimed = arena->Alloc<SpeculativeBlock*>(jobs.Size);
+	intptr_t* leader_of = arena->Alloc<intptr_t>(jobs.Size);
+	intptr_t queue_size = 0;
+	intptr_t num_claimed = 0;
+	intptr_t num_shared = 0;
+
+	DS_Map<uint64_t, intptr_t> leaders;
+	leaders.Init(arena);
+
+	uint64_t now = OS_GetTimeMicroseconds();
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		DS_StringView code = jobs[i].Code;
+		jobs[i] = {};
+		jobs[i].Code = code;
+		jobs[i].QueuedTime = now;
+		claimed[i] = NULL;
+		leader_of[i] = -1;
+
+		if (evaluator->Options.CoalesceBlocks)
+		{
+			if (is_cached[i])
+			{
+				const CachedResult& cached = cached_results[i];
+				jobs[i].Result = DS_StringView(arena->Clone(cached.Result.Data, cached.Result.Size), cached.Result.Size);
+				jobs[i].Ok = true;
+				jobs[i].Shared = true;
+				num_shared += 1;
+				continue;
+			}
+
+			intptr_t* leader = leaders.FindPtr(keys[i]);
+			if (leader && jobs[*leader].Code == code)
+			{
+				leader_of[i] = *leader;
+				num_shared += 1;
+				continue;
+			}
+			if (!leader)
+				leaders.Set(keys[i], i);
+		}
+
+		intptr_t index = evaluator->Speculation.Size > 0 ? FindSpeculativeBlock(evaluator, code, keys[i]) : -1;
+		if (index != -1)
+		{
+			SpeculativeBlock* block = evaluator->Speculation[index];
+			bool usable = !block->Claimed && (block->State == SpeculationState_Running || (block->State == SpeculationState_Done && block->Job.Ok));
+			if (usable)
+			{
+				block->Claimed = true;
+				claimed[i] = block;
+				num_claimed += 1;
+				continue;
+			}
+			if (!block->Claimed)
+			{
+				RemoveSpeculativeBlock(evaluator, index);
+				evaluator->Stats.SpeculativeDiscarded += 1;
+			}
+		}
+		queue[queue_size++] = &jobs[i];
+	}
+
+	evaluator->Queue = queue;
+	evaluator->QueueSize = queue_size;
+	evaluator->QueueHead = 0;
+	evaluator->JobsRemaining = queue_size;
+	evaluator->ResultArena = arena;
+	evaluator->Stats.QueueDepth = queue_size;
+	if (queue_size > evaluator->Stats.PeakQueueDepth)
+		evaluator->Stats.PeakQueueDepth = queue_size;
+	OS_ConditionVariableBroadcast(&evaluator->WorkAvailable);
+
+	uint32_t scale_up_wait_ms = evaluator->Options.ScaleUpWaitMs > 0 ? evaluator->Options.ScaleUpWaitMs : 1;
+	for (;;)
+	{
+		bool waiting_for_speculation = false;
+		for (intptr_t i = 0; i < jobs.Size && !waiting_for_speculation; i++)
+			waiting_for_speculation = claimed[i] && claimed[i]->State != SpeculationState_Done;
+
+		if (evaluator->JobsRemaining == 0 && !waiting_for_speculation)
+			break;
+
+		// Scale up if the oldest queued block has been waiting for too long. Workers that are still starting up will soon take
+		// jobs from the queue, so we only start more of them if there's queued work left over. To not overshoot with short
+		// blocks, the pool at most doubles in size at a time.
+		intptr_t queue_depth = evaluator->QueueSize - evaluator->QueueHead;
+		if (queue_depth > evaluator->NumStartingWorkers && evaluator->Stats.NumWorkers < evaluator->Options.MaxWorkers)
+		{
+			uint64_t waited_ms = (OS_GetTimeMicroseconds() - evaluator->Queue[evaluator->QueueHead]->QueuedTime) / 1000;
+			if (waited_ms >= scale_up_wait_ms || evaluator->Stats.NumWorkers == 0)
+			{
+				intptr_t num_new = queue_depth - evaluator->NumStartingWorkers;
+				if (num_new > evaluator->Stats.NumWorkers) num_new = evaluator->Stats.NumWorkers > 0 ? evaluator->Stats.NumWorkers : 1;
+				if (num_new > evaluator->Options.MaxWorkers - evaluator->Stats.NumWorkers) num_new = evaluator->Options.MaxWorkers - evaluator->Stats.NumWorkers;
+
+				for (intptr_t i = 0; i < num_new; i++)
+					StartWorkerThread(evaluator);
+			}
+		}
+
+		OS_ConditionVariableWait(&evaluator->WorkDone, &evaluator->Mutex, scale_up_wait_ms);
+	}
+
+	evaluator->Queue = NULL;
+	evaluator->QueueSize = 0;
+	evaluator->QueueHead = 0;
+	evaluator->ResultArena = NULL;
+
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		SpeculativeBlock* block = claimed[i];
+		if (!block)
+			continue;
+
+		DS_StringView code = jobs[i].Code;
+		jobs[i] = block->Job;
+		jobs[i].Code = code;
+		jobs[i].Result = DS_StringView(arena->Clone(block->Job.Result.Data, block->Job.Result.Size), block->Job.Result.Size);
+
+		for (intptr_t j = 0; j < evaluator->Speculation.Size; j++)
+		{
+			if (evaluator->Speculation[j] == block)
+			{
+				RemoveSpeculativeBlock(evaluator, j);
+				break;
+			}
+		}
+	}
+	evaluator->Stats.SpeculativeHits += num_claimed;
+
+	for (intptr_t i = 0; i < jobs.Size; i++)
+	{
+		if (leader_of[i] != -1)
+		{
+			const EvalJob& leader = jobs[leader_of[i]];
+			jobs[i].Result = leader.Result;
+			jobs[i].Ok = leader.Ok;
+			jobs[i].Shared = true;
+		}
+		else if (evaluator->Options.CoalesceBlocks && jobs[i].Ok && !jobs[i].Shared)
+		{
+			// Only this thread adds to the cache while it holds the mutex, so the key can't be added between Find and Add. The strings
+			// are cloned before Add publishes them to readers, and the arena never moves them.
+			CachedResult cached;
+			if (!evaluator->ResultCache.Find(keys[i], &cached))
+			{
+				DS_Arena* cache_arena = &evaluator->ResultCacheArena;
+				cached.Code = DS_StringView(cache_arena->Clone(jobs[i].Code.Data, jobs[i].Code.Size), jobs[i].Code.Size);
+				cached.Result = DS_StringView(cache_arena->Clone(jobs[i].Result.Data, jobs[i].Result.Size), jobs[i].Result.Size);
+				evaluator->ResultCache.Add(keys[i], cached);
+			}
+		}
+	}
+	evaluator->Stats.BlocksShared += num_shared;
+	OS_MutexUnlock(&evaluator->Mutex);
+
+	bool ok = true;
+	for (intptr_t i = 0; i < jobs.Size; i++)
+		ok = ok && jobs[i].Ok;
+	return ok;
+}
+
+EvaluatorStats GetEvaluatorStats(Evaluator* evaluator)
+{
+	OS_MutexLock(&evaluator->Mutex);
+	EvaluatorStats stats = evaluator->Stats;
+	OS_MutexUnlock(&evaluator->Mutex);
+	return stats;
+}
+
+void PrintEvaluatorStats(Evaluator* evaluator)
+{
+	EvaluatorStats stats = GetEvaluatorStats(evaluator);
+	printf("Workers: %d (peak %d, max %d), started %d, recycled %d, retired when idle %d\n", stats.NumWorkers, stats.PeakWorkers,
+		evaluator->Options.MaxWorkers, stats.WorkersStarted, stats.WorkersRecycled, stats.WorkersRetired);
+	printf("Blocks evaluated: %llu, queue depth: %lld (peak %lld)\n", (unsigned long long)stats.BlocksEvaluated,
+		(long long)stats.QueueDepth, (long long)stats.PeakQueueDepth);
+
+	if (stats.WorkerStartups > 0)
+		printf("Worker startup: %.1f ms average, %.1f ms min, %.1f ms max (%d startups)\n", stats.TotalWorkerStartupUs / 1000.0 / stats.WorkerStartups,
+			stats.MinWorkerStartupUs / 1000.0, stats.MaxWorkerStartupUs / 1000.0, stats.WorkerStartups);
+
+	if (stats.WorkerStartFailures > 0)
+		printf("Worker processes that failed to start: %d\n", stats.WorkerStartFailures);
+
+	if (stats.BlocksShared > 0)
+		printf("Blocks that shared the result of an identical block: %llu\n", (unsigned long long)stats.BlocksShared);
+
+	if (stats.Batches > 0)
+		printf("Batches: %llu, with %.1f blocks on average\n", (unsigned long long)stats.Batches, (double)stats.BlocksBatched / stats.Batches);
+
+	if (stats.SpeculativeBlocksEvaluated > 0 || stats.SpeculativeDiscarded > 0)
+		printf("Speculative blocks: %llu evaluated, %llu used, %llu discarded\n", (unsigned long long)stats.SpeculativeBlocksEvaluated,
+			(unsigned long long)stats.SpeculativeHits, (unsigned long long)stats.SpeculativeDiscarded);
+
+	static const char* bucket_names[EVALUATOR_WAIT_HISTOGRAM_BUCKETS] = { "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s" };
+	printf("Queue wait times:");
+	for (int i = 0; i < EVALUATOR_WAIT_HISTOGRAM_BUCKETS; i++)
+		printf(" %s: %llu%s", bucket_names[i], (unsigned long long)stats.WaitHistogram[i], i + 1 < EVALUATOR_WAIT_HISTOGRAM_BUCKETS ? "," : "\n");
+}
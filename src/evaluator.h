@@ -0,0 +1,94 @@
+
+// Evaluates python code blocks in a pool of long-lived python worker processes.
+//
+// The pool starts with one worker and grows toward `MaxWorkers` while queued blocks wait for longer than `ScaleUpWaitMs`.
+// Workers that have been idle for `IdleTimeoutMs` exit, except for the last one.
+//
+// Identical blocks can be coalesced, so that each distinct block is evaluated only once per run.
+//
+// Blocks that will probably be requested later can be evaluated speculatively by workers that would otherwise be idle.
+//
+// Small blocks, e.g. one-liners, take much less time to evaluate than a round trip to the worker process, so a worker takes several
+// queued small blocks at once and evaluates them in one round trip.
+
+struct EvaluatorOptions {
+	const char* Interpreter; // Path to the python executable. If NULL, the default interpreter of the `py` launcher is used.
+	bool FastStartup;        // Start python without PYTHON* environment variables and without importing `site` until a block needs it
+	bool CoalesceBlocks;     // Evaluate identical blocks only once per run and share the result. Also required for speculation.
+	int MaxWorkers;
+	uint32_t ScaleUpWaitMs;
+	uint32_t IdleTimeoutMs;
+	int RecycleAfterBlocks;     // Replace a worker process after it has evaluated this many blocks. 0 means never.
+	uint64_t RecycleAfterBytes; // Replace a worker process once its working set exceeds this many bytes. 0 means never.
+	uint64_t MemoryLimitBytes;  // Allocations in a worker process fail once it has committed this many bytes. 0 means no limit.
+	uint64_t CPUTimeLimitUs;    // A worker process is terminated if a single block uses more CPU time than this. 0 means no limit.
+	int MaxBatchSize;             // Up to this many small blocks are evaluated in one round trip. 0 or 1 means no batching, as does a CPU time limit.
+	uint32_t MaxBatchedCodeBytes; // Blocks whose code is at most this large count as small
+	bool MeasureEachBlock;        // Turn off batching, so that the peak working set increase of every block is known
+};
+
+struct EvalJob {
+	DS_StringView Code;
+
+	// Set by EvaluateBlocks
+	DS_StringView Result;
+	bool Ok;
+	bool Shared; // The result was taken from an identical block instead of evaluating this one
+	uint64_t QueuedTime;
+
+	// Profiling info, set by EvaluateBlocks
+	uint64_t WallTimeUs;
+	uint64_t CPUTimeUs;
+	uint64_t PeakWorkingSet;         // Peak working set of the worker process after evaluating the block
+	uint64_t PeakWorkingSetIncrease; // How much evaluating the block raised the peak working set of the worker process. 0 for a block that
+	                                 // was evaluated in a batch, since it's only known for the whole batch.
+};
+
+// Wait time buckets: <1ms, <10ms, <100ms, <1s, <10s, >=10s
+#define EVALUATOR_WAIT_HISTOGRAM_BUCKETS 6
+
+struct EvaluatorStats {
+	int NumWorkers;
+	int PeakWorkers;
+	int WorkersStarted;
+	int WorkersRecycled;
+	int WorkersRetired; // Exited because of being idle
+	intptr_t QueueDepth;
+	intptr_t PeakQueueDepth;
+	uint64_t BlocksEvaluated;
+	int WorkerStartups; // Worker processes that have started up successfully, including replacements
+	int WorkerStartFailures; // Worker processes that couldn't be started or exited before they were ready, including replacements
+	uint64_t TotalWorkerStartupUs;
+	uint64_t MinWorkerStartupUs;
+	uint64_t MaxWorkerStartupUs;
+	uint64_t BlocksShared; // Blocks that took the result of an identical block instead of being evaluated
+	uint64_t SpeculativeBlocksEvaluated;
+	uint64_t SpeculativeHits;      // Speculative results that were used by EvaluateBlocks
+	uint64_t SpeculativeDiscarded; // Speculative blocks that were cancelled or whose results were never used
+	uint64_t Batches;       // Round trips that evaluated more than one block
+	uint64_t BlocksBatched; // Blocks evaluated in those round trips
+	uint64_t WaitHistogram[EVALUATOR_WAIT_HISTOGRAM_BUCKETS];
+};
+
+struct Evaluator;
+
+// Prints an error and returns NULL if python couldn't be found or the worker script couldn't be created.
+Evaluator* StartEvaluator(const EvaluatorOptions& options);
+
+void StopEvaluator(Evaluator* evaluator);
+
+// Evaluates all jobs and waits for them to finish. The results are allocated from `arena`.
+// Returns false if any of the jobs couldn't be evaluated because python couldn't be started. If a worker process dies while
+// evaluating a block, e.g. because it exceeded the CPU time limit, the result of that block is an error message.
+bool EvaluateBlocks(Evaluator* evaluator, DS_Arena* arena, DS_Slice<EvalJob> jobs);
+
+// Queues blocks for speculative evaluation at low priority: a worker only takes them when no blocks passed to EvaluateBlocks are
+// waiting. The results are kept in memory, and EvaluateBlocks uses them for jobs with identical code instead of evaluating them again.
+// `group` identifies where the blocks come from, e.g. a file. Speculating a group again cancels its blocks that aren't in `codes`
+// anymore, so passing an empty slice cancels the whole group. The code is copied.
+// Does nothing without the CoalesceBlocks option, since the results are matched to jobs by their code alone.
+void SpeculateBlocks(Evaluator* evaluator, uint64_t group, DS_Slice<DS_StringView> codes);
+
+EvaluatorStats GetEvaluatorStats(Evaluator* evaluator);
+
+void PrintEvaluatorStats(Evaluator* evaluator);
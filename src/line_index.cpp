@@ -0,0 +1,217 @@
+#include "ds/ds.h"
+
+#include "line_index.h"
+#include <emmintrin.h> // SSE2
+
+// Adds `base + i + 1` for each newline at index i of `text`.
+static void AddLineStarts(DS_StringView text, intptr_t base, DS_Array<intptr_t>* out_line_starts)
+{
+	const __m128i newline = _mm_set1_epi8('\n');
+
+	intptr_t i = 0;
+	for (; i + 16 <= text.Size; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(text.Data + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+		while (mask)
+		{
+			int bit = std::countr_zero(mask);
+			out_line_starts->Add(base + i + bit + 1);
+			mask &= mask - 1;
+		}
+	}
+
+	for (; i < text.Size; i++)
+	{
+		if (text.Data[i] == '\n')
+			out_line_starts->Add(base + i + 1);
+	}
+}
+
+// Returns the number of line starts that are <= offset.
+static intptr_t UpperBound(const LineIndex& index, intptr_t offset)
+{
+	intptr_t lo = 0, hi = index.LineStarts.Size;
+	while (lo < hi)
+	{
+		intptr_t mid = (lo + hi) / 2;
+		if (index.LineStarts.Data[mid] <= offset) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+void BuildLineIndex(DS_Arena* arena, DS_StringView text, LineIndex* out_index)
+{
+	out_index->LineStarts = DS_Array<intptr_t>(arena, text.Size / 32 + 1); // Guess ~32 bytes per line to avoid most reallocations
+	out_index->LineStarts.Add(0);
+	out_index->TextSize = text.Size;
+	AddLineStarts(text, 0, &out_index->LineStarts);
+}
+
+void UpdateLineIndex(LineIndex* index, intptr_t offset, intptr_t removed_size, DS_StringView inserted_text)
+{
+	DS_ASSERT(offset >= 0 && offset + removed_size <= index->TextSize);
+	DS_Array<intptr_t>* starts = &index->LineStarts;
+
+	// The line starts in (offset, offset + removed_size] came from newlines in the removed range.
+	intptr_t first_removed = UpperBound(*index, offset);
+	intptr_t end_removed = UpperBound(*index, offset + removed_size);
+	if (end_removed > first_removed)
+		starts->Remove(first_removed, end_removed - first_removed);
+
+	intptr_t delta = inserted_text.Size - removed_size;
+	for (intptr_t i = first_removed; i < starts->Size; i++)
+		starts->Data[i] += delta;
+
+	// Scan the inserted text into the end of the array, then rotate the new line starts into place.
+	intptr_t old_size = starts->Size;
+	AddLineStarts(inserted_text, offset, starts);
+	intptr_t num_new = starts->Size - old_size;
+	if (num_new > 0 && first_removed < old_size)
+	{
+		DS_ScopedArena<1024> temp;
+		intptr_t* new_starts = temp.Clone(starts->Data + old_size, num_new);
+		memmove(starts->Data + first_removed + num_new, starts->Data + first_removed, (old_size - first_removed) * sizeof(intptr_t));
+		memcpy(starts->Data + first_removed, new_starts, num_new * sizeof(intptr_t));
+	}
+
+	index->TextSize += delta;
+}
+
+intptr_t OffsetToLine(const LineIndex& index, intptr_t offset)
+{
+	return UpperBound(index, offset) - 1;
+}
+
+void OffsetToLineColumn(const LineIndex& index, intptr_t offset, intptr_t* out_line, intptr_t* out_column)
+{
+	intptr_t line = OffsetToLine(index, offset);
+	*out_line = line;
+	*out_column = offset - index.LineStarts.Data[line];
+}
+
+intptr_t LineColumnToOffset(const LineIndex& index, intptr_t line, intptr_t column)
+{
+	if (line < 0) return 0;
+	if (line >= index.LineStarts.Size) return index.TextSize;
+
+	intptr_t line_start = index.LineStarts.Data[line];
+	intptr_t line_end = line + 1 < index.LineStarts.Size ? index.LineStarts.Data[line + 1] : index.TextSize;
+	return line_start + (column < line_end - line_start ? column : line_end - line_start);
+}
+
+LineEndingCounts CountLineEndings(DS_StringView text)
+{
+	LineEndingCounts counts = {};
+	if (text.Size == 0)
+		return counts;
+
+	// Byte 0 can't be preceded by a '\r', so the vector loop starts at byte 1 and also loads the bytes one to the left.
+	counts.Newlines = text.Data[0] == '\n';
+
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage_return = _mm_set1_epi8('\r');
+	const __m128i zero = _mm_setzero_si128();
+
+	intptr_t i = 1;
+	while (i + 16 <= text.Size)
+	{
+		// The matches are counted in 8-bit lanes, which are summed up before they can overflow.
+		__m128i newline_counts = zero, crlf_counts = zero;
+		for (int n = 0; n < 255 && i + 16 <= text.Size; n++, i += 16)
+		{
+			__m128i chunk = _mm_loadu_si128((const __m128i*)(text.Data + i));
+			__m128i previous = _mm_loadu_si128((const __m128i*)(text.Data + i - 1));
+			__m128i is_newline = _mm_cmpeq_epi8(chunk, newline);
+			__m128i is_crlf = _mm_and_si128(is_newline, _mm_cmpeq_epi8(previous, carriage_return));
+			newline_counts = _mm_sub_epi8(newline_counts, is_newline);
+			crlf_counts = _mm_sub_epi8(crlf_counts, is_crlf);
+		}
+
+		__m128i newline_sums = _mm_sad_epu8(newline_counts, zero);
+		__m128i crlf_sums = _mm_sad_epu8(crlf_counts, zero);
+		counts.Newlines += _mm_cvtsi128_si32(newline_sums) + _mm_cvtsi128_si32(_mm_srli_si128(newline_sums, 8));
+		counts.CRLFs += _mm_cvtsi128_si32(crlf_sums) + _mm_cvtsi128_si32(_mm_srli_si128(crlf_sums, 8));
+	}
+
+	for (; i < text.Size; i++)
+	{
+		if (text.Data[i] == '\n')
+		{
+			counts.Newlines += 1;
+			counts.CRLFs += text.Data[i - 1] == '\r';
+		}
+	}
+	return counts;
+}
+
+DS_StringView DetectLineEnding(DS_StringView text)
+{
+	LineEndingCounts counts = CountLineEndings(text);
+	return counts.CRLFs > counts.Newlines - counts.CRLFs ? DS_StringView("\r\n") : DS_StringView("\n");
+}
+
+void ReindentLines(DS_StringView text, DS_StringView indent, DS_StringView line_ending, int flags, DS_DynamicString* out)
+{
+	DS_ScopedArena<4096> temp;
+
+	// Line i spans [line_starts[i], line_starts[i + 1]), so the text end is added as a sentinel unless the text ends with a newline.
+	DS_Array<intptr_t> line_starts(&temp, text.Size / 32 + 2);
+	line_starts.Add(0);
+	AddLineStarts(text, 0, &line_starts);
+	bool last_line_has_newline = line_starts.Back() == text.Size;
+	if (!last_line_has_newline)
+		line_starts.Add(text.Size);
+
+	// First pass: find the contents of each line without the line ending, and sum up the output size.
+	intptr_t num_lines = line_starts.Size - 1;
+	DS_StringView* lines = temp.Alloc<DS_StringView>(num_lines);
+	bool* add_indent = temp.Alloc<bool>(num_lines);
+	intptr_t output_size = 0;
+	for (intptr_t i = 0; i < num_lines; i++)
+	{
+		intptr_t start = line_starts[i], end = line_starts[i + 1];
+		bool has_newline = i + 1 < num_lines || last_line_has_newline;
+		if (has_newline) end -= 1;
+		if (has_newline && end > start && text.Data[end - 1] == '\r') end -= 1; // A lone "\r" at the end isn't a line ending
+
+		lines[i] = text.Slice(start, end);
+		add_indent[i] = !(flags & ReindentFlags_OnlyUnindentedLines) || lines[i].Size == 0 || (lines[i].Data[0] != ' ' && lines[i].Data[0] != '\t');
+
+		if (lines[i].Size == 0 && (flags & ReindentFlags_SkipEmptyLines))
+		{
+			lines[i].Data = NULL; // Marks the line as skipped
+			continue;
+		}
+
+		bool add_line_ending = has_newline || (flags & ReindentFlags_TerminateLastLine);
+		output_size += (add_indent[i] ? indent.Size : 0) + lines[i].Size + (add_line_ending ? line_ending.Size : 0);
+	}
+
+	// Second pass: copy the lines into place.
+	out->Reserve(out->Size + output_size + 1);
+	char* dest = out->Data + out->Size;
+	for (intptr_t i = 0; i < num_lines; i++)
+	{
+		if (lines[i].Data == NULL)
+			continue;
+
+		if (add_indent[i])
+		{
+			memcpy(dest, indent.Data, indent.Size);
+			dest += indent.Size;
+		}
+		memcpy(dest, lines[i].Data, lines[i].Size);
+		dest += lines[i].Size;
+
+		if (i + 1 < num_lines || last_line_has_newline || (flags & ReindentFlags_TerminateLastLine))
+		{
+			memcpy(dest, line_ending.Data, line_ending.Size);
+			dest += line_ending.Size;
+		}
+	}
+
+	out->Size += output_size;
+	out->Data[out->Size] = 0;
+}
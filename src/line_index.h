@@ -0,0 +1,44 @@
+
+// Line-oriented text utilities.
+//
+// A line index stores the line starts of a text, for mapping between byte offsets and line/column positions in O(log n).
+// Lines and columns are zero-based, and columns are in bytes. In "\r\n" line endings, the "\r" is the last byte of the line.
+
+struct LineIndex {
+	DS_Array<intptr_t> LineStarts; // Offsets of the first byte of each line. There's always at least one line, starting at 0.
+	intptr_t TextSize;
+};
+
+// Finds the newlines 16 bytes at a time with SSE2. The index is allocated from `arena`.
+void BuildLineIndex(DS_Arena* arena, DS_StringView text, LineIndex* out_index);
+
+// Updates the index after `removed_size` bytes at `offset` were replaced with `inserted_text`, without rescanning the rest of the text.
+void UpdateLineIndex(LineIndex* index, intptr_t offset, intptr_t removed_size, DS_StringView inserted_text);
+
+intptr_t OffsetToLine(const LineIndex& index, intptr_t offset);
+
+void OffsetToLineColumn(const LineIndex& index, intptr_t offset, intptr_t* out_line, intptr_t* out_column);
+
+// The column is clamped to the end of the line, including its line ending.
+intptr_t LineColumnToOffset(const LineIndex& index, intptr_t line, intptr_t column);
+
+struct LineEndingCounts {
+	intptr_t Newlines; // All "\n", including the ones in "\r\n"
+	intptr_t CRLFs;
+};
+
+// Counts the line endings of `text` with SSE2, at roughly the speed of a memcpy.
+LineEndingCounts CountLineEndings(DS_StringView text);
+
+// Returns the line ending style that most lines of `text` use, "\r\n" or "\n". Text without line endings gets "\n".
+DS_StringView DetectLineEnding(DS_StringView text);
+
+enum ReindentFlags {
+	ReindentFlags_SkipEmptyLines = 1 << 0,
+	ReindentFlags_OnlyUnindentedLines = 1 << 1, // Only add the indent to lines that don't start with a space or a tab
+	ReindentFlags_TerminateLastLine = 1 << 2,   // Add a line ending after the last line even if it didn't have one
+};
+
+// Adds the lines of `text` to `out` with `indent` added to the start of each line, and each line ending ("\r\n" or "\n") replaced
+// with `line_ending`. The newlines are found with SSE2, the output size is computed up front, and each line is written with one copy.
+void ReindentLines(DS_StringView text, DS_StringView indent, DS_StringView line_ending, int flags, DS_DynamicString* out);
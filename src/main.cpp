@@ -4,182 +4,707 @@
 #include "ds/ds.h"
 
 #include "win32_utils.h"
+#include "evaluator.h"
+#include "line_index.h"
+#include "block_parser.h"
 
-static bool ReadEntireFile(DS_Arena* arena, const char* filepath, DS_StringView* out_data)
+// How many times the expansion is redone if another process modifies the file while we are evaluating its python blocks.
+#define MAX_EXPAND_ATTEMPTS 16
+
+struct ExpandOptions
 {
-	FILE* f = NULL;
-	errno_t err = fopen_s(&f, filepath, "rb");
-	if (f) {
-		fseek(f, 0, SEEK_END);
-		long fsize = ftell(f);
-		fseek(f, 0, SEEK_SET);
-
-		char* data = arena->PushUninitialized(fsize);
-		fread(data, fsize, 1, f);
-
-		fclose(f);
-		*out_data = {data, fsize};
-	}
-	return f != NULL;
-}
+    bool PrintProfile;
+};
 
-// Usage:
-// PyExpand my_file.cpp
-int main(int argc, const char** argv)
+// Outputs smaller than this are spliced on the calling thread, since starting threads costs more than copying
+#define PARALLEL_SPLICE_MIN_BYTES (4 * 1024 * 1024)
+
+struct SpliceTask
 {
-    DS_ScopedArena<2048> arena;
+    OS_Thread Thread;
+    DS_Slice<DS_StringView> Pieces;
+    const intptr_t* Offsets; // Output offset of each piece
+    char* Dest;
+    intptr_t Begin; // Range of output bytes written by this task
+    intptr_t End;
+};
 
-    if (argc != 2)
+static void SpliceRange(void* arg)
+{
+    SpliceTask* task = (SpliceTask*)arg;
+
+    // Binary search for the last piece that starts at or before `Begin`
+    intptr_t lo = 0, hi = task->Pieces.Size;
+    while (hi - lo > 1)
     {
-        printf("Please provide exactly one argument (the file name)!\n");
-        return 1;
+        intptr_t mid = (lo + hi) / 2;
+        if (task->Offsets[mid] <= task->Begin) lo = mid;
+        else hi = mid;
     }
 
-    const char* filepath = argv[1];
-    
-    DS_StringView file_data;
-    if (!ReadEntireFile(&arena, filepath, &file_data))
+    for (intptr_t i = lo; i < task->Pieces.Size && task->Offsets[i] < task->End; i++)
     {
-        printf("Failed to read file '%s'!\n", filepath);
-        return 1;
+        intptr_t piece_begin = task->Offsets[i];
+        intptr_t piece_end = piece_begin + task->Pieces[i].Size;
+        intptr_t begin = piece_begin > task->Begin ? piece_begin : task->Begin;
+        intptr_t end = piece_end < task->End ? piece_end : task->End;
+        if (begin < end)
+            memcpy(task->Dest + begin, task->Pieces[i].Data + (begin - piece_begin), end - begin);
+    }
+}
+
+// Concatenates `pieces` into `out_result`. The output offsets are computed up front with a prefix sum, so the output is allocated
+// once, and large outputs are copied in parallel with each thread writing an equally sized range of the output.
+static void SplicePieces(DS_Arena* arena, DS_Slice<DS_StringView> pieces, DS_DynamicString* out_result)
+{
+    intptr_t* offsets = arena->Alloc<intptr_t>(pieces.Size);
+    intptr_t total_size = 0;
+    for (intptr_t i = 0; i < pieces.Size; i++)
+    {
+        offsets[i] = total_size;
+        total_size += pieces[i].Size;
     }
-    
-    DS_Array<DS_StringView> ranges_to_keep(&arena);
-    DS_Array<DS_StringView> python_strings(&arena);
-    DS_Array<bool> python_strings_is_multiline(&arena);
-    DS_Array<DS_StringView> python_results(&arena);
 
-    DS_StringView remaining = file_data;
-    for (;;)
+    intptr_t base = out_result->Size;
+    out_result->Reserve(base + total_size + 1);
+    char* dest = out_result->Data + base;
+
+    intptr_t num_tasks = total_size / PARALLEL_SPLICE_MIN_BYTES + 1;
+    if (num_tasks > OS_GetProcessorCount()) num_tasks = OS_GetProcessorCount();
+
+    if (num_tasks <= 1)
     {
-        DS_StringView pyexpand_keyword = "/*.py";
-        intptr_t pyexpand_offset = remaining.Find(pyexpand_keyword);
-        if (pyexpand_offset == remaining.Size)
-            break;
+        for (intptr_t i = 0; i < pieces.Size; i++)
+            memcpy(dest + offsets[i], pieces[i].Data, pieces[i].Size);
+    }
+    else
+    {
+        SpliceTask* tasks = arena->Alloc<SpliceTask>(num_tasks);
+        for (intptr_t i = 0; i < num_tasks; i++)
+        {
+            tasks[i] = {};
+            tasks[i].Pieces = pieces;
+            tasks[i].Offsets = offsets;
+            tasks[i].Dest = dest;
+            tasks[i].Begin = total_size * i / num_tasks;
+            tasks[i].End = total_size * (i + 1) / num_tasks;
+        }
+
+        // The calling thread does the first range itself. If a thread can't be started, its range is done here as well.
+        bool* started = arena->Alloc<bool>(num_tasks);
+        for (intptr_t i = 1; i < num_tasks; i++)
+            started[i] = OS_StartThread(&tasks[i].Thread, SpliceRange, &tasks[i]);
+
+        SpliceRange(&tasks[0]);
+        for (intptr_t i = 1; i < num_tasks; i++)
+        {
+            if (started[i]) OS_JoinThread(&tasks[i].Thread);
+            else SpliceRange(&tasks[i]);
+        }
+    }
 
-        intptr_t end_comment_offset = remaining.Find("*/", pyexpand_offset + pyexpand_keyword.Size);
-        DS_StringView python_string = remaining.Slice(pyexpand_offset + pyexpand_keyword.Size, end_comment_offset);
-        ranges_to_keep.Add(remaining.Slice(0, end_comment_offset + 2));
+    out_result->Size = base + total_size;
+    out_result->Data[out_result->Size] = 0;
+}
 
-        intptr_t terminator_comment_offset = remaining.Find("/*", end_comment_offset + 2);
-        remaining = remaining.Slice(terminator_comment_offset);
+// Python prints this first when an exception isn't caught
+static const DS_StringView PYTHON_TRACEBACK_HEADER = "Traceback (most recent call last):";
 
-        DS_DynamicString new_python_string(&arena);
+// Parses `file_data` for python blocks, evaluates them and writes the expanded file contents into `out_result`.
+// `filepath` is only used for messages.
+static bool ExpandFileData(DS_Arena* arena, Evaluator* evaluator, const ExpandOptions& options, const char* filepath, DS_StringView file_data, DS_DynamicString* out_result)
+{
+    DS_Array<DS_StringView> ranges_to_keep(arena);
+    DS_Array<PythonBlock> python_blocks(arena);
+    DS_Array<EvalJob> python_jobs(arena);
+    DS_Array<DS_StringView> python_results(arena);
 
-        bool is_multiline = python_string.Find("return") != python_string.Size;
-        if (is_multiline)
+    GetFileParser(filepath)(arena, file_data, &ranges_to_keep, &python_blocks);
+    python_jobs.Resize(python_blocks.Size, EvalJob{});
+
+    // A block is evaluated in the wave after the last of the named blocks it uses, and all blocks of a wave are evaluated
+    // together, so independent blocks still run in parallel. Without named blocks, all blocks are evaluated in one wave.
+    int* block_waves = arena->Alloc<int>(python_blocks.Size);
+    int num_waves = python_blocks.Size > 0 ? 1 : 0;
+    for (intptr_t i = 0; i < python_blocks.Size; i++)
+    {
+        block_waves[i] = 0;
+        DS_Slice<intptr_t> dependencies = python_blocks[i].Dependencies;
+        for (intptr_t j = 0; j < dependencies.Size; j++)
+            if (block_waves[dependencies[j]] + 1 > block_waves[i])
+                block_waves[i] = block_waves[dependencies[j]] + 1;
+        if (block_waves[i] + 1 > num_waves)
+            num_waves = block_waves[i] + 1;
+    }
+
+    // Pickled return values of the named blocks, base64-encoded. Empty if the block failed.
+    DS_StringView* block_values = arena->Alloc<DS_StringView>(python_blocks.Size);
+
+    for (int wave = 0; wave < num_waves; wave++)
+    {
+        DS_Array<EvalJob> wave_jobs(arena);
+        DS_Array<intptr_t> wave_blocks(arena);
+        for (intptr_t i = 0; i < python_blocks.Size; i++)
         {
-            new_python_string.Add("def user_fn():\n");
-            DS_StringView lines = python_string;
-            while (lines.Size > 0)
+            if (block_waves[i] != wave)
+                continue;
+
+            python_jobs[i] = {};
+            block_values[i] = DS_StringView();
+            const PythonBlock& block = python_blocks[i];
+
+            // The values of the named blocks are unpickled into globals of the same names before the code runs
+            DS_DynamicString code(arena);
+            DS_StringView failed_dependency;
+            for (intptr_t j = 0; j < block.Dependencies.Size; j++)
             {
-                DS_StringView line = lines.Split("\n");
-                if (line.Size > 0 && line.Data[line.Size - 1] == '\r')
-                    line.Size -= 1;
-                
-                if (line.Size > 0)
+                intptr_t dependency = block.Dependencies[j];
+                if (block_values[dependency].Size == 0)
                 {
-                    if (line.Data[0] != '\t' && line.Data[0] != ' ')
-                        new_python_string.Add("\t");
-                    new_python_string.Add(line);
-                    new_python_string.Add("\n");
+                    failed_dependency = python_blocks[dependency].Name;
+                    break;
                 }
+                if (j == 0)
+                    code.Add("import pickle, base64\n");
+                code.Addf("%.*s = pickle.loads(base64.b64decode('", DS_StrVArg(python_blocks[dependency].Name));
+                code.Add(block_values[dependency]);
+                code.Add("'))\n");
             }
-            new_python_string.Addf("print(user_fn())\n");
+
+            if (failed_dependency.Size > 0)
+            {
+                DS_DynamicString message(arena);
+                message.Addf("Error: The block named '%.*s' has no value, since it failed.", DS_StrVArg(failed_dependency));
+                python_jobs[i].Code = block.Code;
+                python_jobs[i].Result = message;
+                python_jobs[i].Ok = true;
+                continue;
+            }
+
+            EvalJob job = {};
+            job.Code = block.Code;
+            if (code.Size > 0)
+            {
+                code.Add(block.Code);
+                job.Code = code;
+            }
+            wave_jobs.Add(job);
+            wave_blocks.Add(i);
         }
-        else
+
+        if (!EvaluateBlocks(evaluator, arena, wave_jobs))
         {
-            DS_StringView lines = python_string;
-            int lines_count = 0;
-            while (lines.Size > 0)
+            printf("Failed to call python. Do you have python installed?\n");
+            return false;
+        }
+
+        for (intptr_t j = 0; j < wave_jobs.Size; j++)
+        {
+            intptr_t i = wave_blocks[j];
+            python_jobs[i] = wave_jobs[j];
+            if (python_blocks[i].Name.Size == 0)
+                continue;
+
+            // Split the value off the result. If the block raised an exception, e.g. because the value couldn't be pickled,
+            // there is no value, and the traceback is the result.
+            DS_StringView result = python_jobs[i].Result;
+            intptr_t marker_offset = result.RFind(BLOCK_VALUE_MARKER);
+            if (marker_offset == result.Size)
+                continue;
+
+            DS_StringView value = result.Slice(marker_offset + BLOCK_VALUE_MARKER.Size);
+            while (value.Size > 0 && (value.Data[value.Size - 1] == '\n' || value.Data[value.Size - 1] == '\r'))
+                value.Size -= 1;
+            block_values[i] = value;
+            python_jobs[i].Result = result.Slice(0, marker_offset);
+        }
+    }
+
+    // Line numbers are only needed for messages, so the index is built lazily.
+    LineIndex line_index = {};
+    bool has_line_index = false;
+
+    for (intptr_t i = 0; i < python_jobs.Size; i++)
+    {
+        // Point at the block in the same format as compiler diagnostics, so that IDEs can jump to it
+        if (python_jobs[i].Result.Find(PYTHON_TRACEBACK_HEADER) != python_jobs[i].Result.Size)
+        {
+            if (!has_line_index) BuildLineIndex(arena, file_data, &line_index);
+            has_line_index = true;
+
+            intptr_t line, column;
+            OffsetToLineColumn(line_index, python_blocks[i].Offset, &line, &column);
+            printf("%s(%lld,%lld): warning: python block raised an exception\n", filepath, (long long)line + 1, (long long)column + 1);
+        }
+    }
+
+    if (options.PrintProfile)
+    {
+        if (!has_line_index) BuildLineIndex(arena, file_data, &line_index);
+        has_line_index = true;
+
+        for (intptr_t i = 0; i < python_jobs.Size; i++)
+        {
+            const EvalJob& job = python_jobs[i];
+            long long line = (long long)OffsetToLine(line_index, python_blocks[i].Offset) + 1;
+
+            // Identify the block by its first non-empty line
+            DS_StringView first_line, lines = python_blocks[i].Source;
+            while (lines.Size > 0 && first_line.Size == 0)
             {
-                DS_StringView line = lines.Split("\n");
-                lines_count += 1;
+                first_line = lines.Split("\n");
+                while (first_line.Size > 0 && (first_line.Data[0] == ' ' || first_line.Data[0] == '\t'))
+                    first_line = first_line.Slice(1);
+                while (first_line.Size > 0 && (first_line.Data[first_line.Size - 1] == ' ' || first_line.Data[first_line.Size - 1] == '\r'))
+                    first_line = first_line.Slice(0, first_line.Size - 1);
             }
-            if (lines_count <= 1)
+            if (first_line.Size > 40)
+                first_line = first_line.Slice(0, 40);
+
+            if (job.Shared)
             {
-                new_python_string.Addf("print(%.*s)\n", python_string.Size, python_string.Data);
+                printf("Block %lld (line %lld: %.*s): shared the result of an identical block\n", (long long)i, line, (int)first_line.Size, first_line.Data);
+                continue;
             }
-            else
-                new_python_string.Add("print('Error: No return statement found in a multiline code block!')");
+
+            printf("Block %lld (line %lld: %.*s): %.2f ms wall, %.2f ms CPU, peak working set %.1f MB (+%.1f MB)\n", (long long)i, line, (int)first_line.Size, first_line.Data,
+                job.WallTimeUs / 1000.0, job.CPUTimeUs / 1000.0, job.PeakWorkingSet / (1024.0 * 1024.0), job.PeakWorkingSetIncrease / (1024.0 * 1024.0));
+        }
+    }
+
+    // Results are written with the line ending style that most lines of the file use, so that expanding a file doesn't mix styles
+    DS_StringView line_ending = DetectLineEnding(file_data);
+
+    for (intptr_t i = 0; i < python_jobs.Size; i++)
+    {
+        DS_StringView python_result = python_jobs[i].Result;
+        // Not printed with %.*s, since its precision argument is an int and results can be larger than 2 GB
+        printf("Python result: ");
+        fwrite(python_result.Data, 1, python_result.Size, stdout);
+        printf("\n");
+
+        if (python_result.Size >= 1 && python_result.Data[python_result.Size - 1] == '\n')
+        {
+            python_result.Size -= 1;
+            if (python_result.Size >= 1 && python_result.Data[python_result.Size - 1] == '\r')
+                python_result.Size -= 1;
         }
 
-        python_strings.Add(new_python_string);
-        python_strings_is_multiline.Add(is_multiline);
+        // Most results either have no line endings or already use the right style, so they don't need to be copied
+        LineEndingCounts counts = CountLineEndings(python_result);
+        bool needs_normalizing = line_ending.Size == 2 ? counts.CRLFs != counts.Newlines : counts.CRLFs != 0;
+        if (needs_normalizing)
+        {
+            DS_DynamicString normalized(arena);
+            ReindentLines(python_result, "", line_ending, 0, &normalized);
+            python_result = normalized;
+        }
+
+        python_results.Add(python_result);
     }
-    ranges_to_keep.Add(remaining);
 
-    for (int i = 0; i < python_strings.Size; i++)
+    DS_Array<DS_StringView> pieces(arena, ranges_to_keep.Size * 5);
+    for (intptr_t i = 0; i < ranges_to_keep.Size; i++)
     {
-        FILE* f = fopen("__pyexpand_temp.py", "wb");
-        if (!f)
+        if (i > 0)
         {
-            printf("Failed to create a temporary python file for evaluating python expressions!\n");
-            return 1;
+            DS_StringView python_string = python_results[i - 1];
+            intptr_t indent = 0;
+            for (; indent < python_string.Size; indent++)
+                if (python_string.Data[indent] != ' ' && python_string.Data[indent] != '\t')
+                    break;
+            bool is_multiline = python_blocks[i - 1].IsMultiline;
+            DS_StringView indent_str = python_string.Slice(0, is_multiline ? indent : 0);
+
+            pieces.Add(is_multiline ? line_ending : " ");
+            pieces.Add(python_results[i - 1]);
+            pieces.Add(is_multiline ? line_ending : " ");
+            pieces.Add(indent_str);
         }
-        DS_StringView python_str = python_strings[i];
-        fprintf(f, "%.*s\n", (int)python_str.Size, python_str.Data);
+        pieces.Add(ranges_to_keep[i]);
+    }
+    SplicePieces(arena, pieces, out_result);
+
+    return true;
+}
+
+// Granularity of the comparison when patching a file in place
+#define PATCH_CHUNK_SIZE 4096
+
+// If the expanded file has the same size as the current one, e.g. when only a few generated constants have changed, only the
+// changed chunks are written into the existing file. Otherwise, the file is rewritten atomically. Must be called under the file lock.
+static bool WriteExpandedFile(const char* filepath, DS_StringView old_data, DS_StringView new_data)
+{
+    if (new_data.Size == old_data.Size)
+    {
+        // Find the changed chunks first, so that each run of consecutive changed chunks can be written at once
+        intptr_t num_chunks = (new_data.Size + PATCH_CHUNK_SIZE - 1) / PATCH_CHUNK_SIZE;
+        DS_ScopedArena<1024> temp;
+        DS_BitSet dirty_chunks;
+        dirty_chunks.Init(num_chunks, &temp);
+        for (intptr_t i = 0; i < num_chunks; i++)
+        {
+            intptr_t offset = i * PATCH_CHUNK_SIZE;
+            intptr_t size = new_data.Size - offset < PATCH_CHUNK_SIZE ? new_data.Size - offset : PATCH_CHUNK_SIZE;
+            if (memcmp(old_data.Data + offset, new_data.Data + offset, size) != 0)
+                dirty_chunks.Set(i);
+        }
+
+        OS_File file;
+        if (OS_OpenFileForPatching(filepath, &file))
+        {
+            bool ok = true;
+            for (intptr_t first = dirty_chunks.FindNextSet(0); ok && first < num_chunks;)
+            {
+                intptr_t end = dirty_chunks.FindNextClear(first);
+                intptr_t offset = first * PATCH_CHUNK_SIZE;
+                intptr_t end_offset = end * PATCH_CHUNK_SIZE < new_data.Size ? end * PATCH_CHUNK_SIZE : new_data.Size;
+                ok = OS_WriteFileAt(&file, offset, new_data.Data + offset, end_offset - offset);
+                first = dirty_chunks.FindNextSet(end);
+            }
+            OS_CloseFile(&file);
+
+            if (ok)
+                return true;
+        }
+    }
+
+    if (OS_WriteFileAtomically(filepath, new_data))
+        return true;
+
+    // The file can't be replaced, e.g. because another program has it open without allowing it to be deleted. Overwrite it instead.
+    FILE* f = fopen(filepath, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(new_data.Data, 1, new_data.Size, f) == (size_t)new_data.Size;
+    return fclose(f) == 0 && ok;
+}
+
+// Expands the file at `filepath` in place. `out_output_hash` is set to the DS_Hash64 of the file's contents after expansion.
+static bool ExpandFile(DS_Arena* arena, Evaluator* evaluator, const ExpandOptions& options, const char* filepath, uint64_t* out_output_hash)
+{
+    for (int attempt = 0;; attempt++)
+    {
+        DS_ArenaMark mark = arena->GetMark();
+
+        DS_StringView file_data;
+        if (!OS_ReadEntireFile(arena, filepath, &file_data))
+        {
+            printf("Failed to read file '%s'!\n", filepath);
+            return false;
+        }
+
+        DS_DynamicString result(arena);
+        if (!ExpandFileData(arena, evaluator, options, filepath, file_data, &result))
+            return false;
+
+        // Evaluating the python code can take a while, so instead of holding the lock for the whole expansion, we only lock the file
+        // for writing and check that nobody modified it in the meantime. If somebody did, the file is expanded again.
+        OS_FileLock lock;
+        if (!OS_LockFile(filepath, &lock))
+        {
+            printf("Failed to lock file '%s'!\n", filepath);
+            return false;
+        }
+
+        DS_StringView current_data;
+        bool unchanged = OS_ReadEntireFile(arena, filepath, &current_data) && current_data == file_data;
+        bool write_ok = true;
+        if (unchanged && !(current_data == result)) // Don't touch the file if there's nothing to change
+            write_ok = WriteExpandedFile(filepath, current_data, result);
+
+        OS_UnlockFile(&lock);
+
+        if (!write_ok)
+        {
+            printf("Failed to write the result to '%s'!\n", filepath);
+            return false;
+        }
+
+        if (unchanged)
+        {
+            *out_output_hash = DS_Hash64(result.Data, result.Size);
+            break;
+        }
+
+        if (attempt + 1 == MAX_EXPAND_ATTEMPTS)
+        {
+            printf("File '%s' kept being modified during expansion, giving up!\n", filepath);
+            return false;
+        }
+
+        printf("File '%s' was modified during expansion, retrying...\n", filepath);
+        arena->SetMark(mark);
+    }
+
+    return true;
+}
+
+// The progress journal is an append-only text file with a line for each file that has been expanded: the DS_Hash64 of
+// the file's contents after expansion as 16 hex digits, a space, and the file path. With --resume, files whose current contents
+// match their latest journal entry are skipped, so a long batch run that died can be restarted without redoing finished files.
+
+static uint64_t FilePathKey(DS_StringView filepath)
+{
+    uint64_t key = DS_Hash64(filepath.Data, filepath.Size);
+    return key != 0 ? key : 1; // 0 is reserved for empty map slots
+}
+
+// Loads the latest output hash of each file in the journal. A missing journal is treated as empty.
+static void LoadJournal(DS_Arena* arena, const char* journal_path, DS_Map<uint64_t, uint64_t>* entries)
+{
+    DS_StringView data;
+    if (!OS_ReadEntireFile(arena, journal_path, &data))
+        return;
+
+    while (data.Size > 0)
+    {
+        DS_StringView line = data.Split("\n");
+        if (line.Size > 0 && line.Data[line.Size - 1] == '\r')
+            line.Size -= 1;
+
+        // Skip malformed lines, e.g. a partially written last line from a run that was killed
+        if (line.Size < 18 || line.Data[16] != ' ')
+            continue;
+
+        uint64_t output_hash = 0;
+        bool valid = true;
+        for (int i = 0; i < 16; i++)
+        {
+            char c = line.Data[i];
+            uint64_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+            valid = valid && digit < 16;
+            output_hash = (output_hash << 4) | (digit & 15);
+        }
+
+        if (valid)
+            entries->Set(FilePathKey(line.Slice(17)), output_hash);
+    }
+}
+
+static bool AppendToJournal(const char* journal_path, const char* filepath, uint64_t output_hash)
+{
+    // Several PyExpand processes may share the same journal, e.g. when a batch is split into shards, so the append is done under a lock.
+    OS_FileLock lock;
+    if (!OS_LockFile(journal_path, &lock))
+        return false;
+
+    FILE* f = fopen(journal_path, "ab");
+    if (f)
+    {
+        fprintf(f, "%016llx %s\n", (unsigned long long)output_hash, filepath);
         fclose(f);
+    }
+
+    OS_UnlockFile(&lock);
+    return f != NULL;
+}
+
+// Queues the blocks of a file that will be expanded later for speculative evaluation, so that their results are ready by the time
+// the file is expanded. If the file changes in the meantime, the blocks that have changed simply won't match and are evaluated normally.
+static void SpeculateFile(DS_Arena* arena, Evaluator* evaluator, const char* filepath)
+{
+    DS_ArenaMark mark = arena->GetMark();
+
+    DS_StringView file_data;
+    if (OS_ReadEntireFile(arena, filepath, &file_data))
+    {
+        DS_Array<DS_StringView> ranges_to_keep(arena);
+        DS_Array<PythonBlock> blocks(arena);
+        GetFileParser(filepath)(arena, file_data, &ranges_to_keep, &blocks);
 
-        struct PrintCallback {
-            OS_RunProcessPrintCallback Base;
-            DS_DynamicString Result;
-        } print_callback;
-        print_callback.Result.Init(&arena);
-        print_callback.Base.Print = [](OS_RunProcessPrintCallback* self, const char* message) {
-            ((PrintCallback*)self)->Result.Addf("%s", message);
-        };
-        
-        uint32_t exit_code;
-        if (!OS_RunConsoleCommand("py __pyexpand_temp.py", true, &exit_code, &print_callback.Base))
+        DS_Array<DS_StringView> codes(arena);
+        for (intptr_t i = 0; i < blocks.Size; i++)
         {
-            printf("Failed to call python. Do you have python installed?\n");
+            // The code of a block that uses named blocks is only known once their values are
+            if (blocks[i].Dependencies.Size == 0)
+                codes.Add(blocks[i].Code);
+        }
+        SpeculateBlocks(evaluator, FilePathKey(DS_Str(filepath)), codes);
+    }
+
+    arena->SetMark(mark);
+}
+
+static bool IsAlreadyExpanded(DS_Arena* arena, DS_Map<uint64_t, uint64_t>* journal_entries, const char* filepath)
+{
+    uint64_t journaled_hash;
+    if (!journal_entries->Find(FilePathKey(DS_Str(filepath)), &journaled_hash))
+        return false;
+
+    DS_ArenaMark mark = arena->GetMark();
+    DS_StringView current_data;
+    bool already_expanded = OS_ReadEntireFile(arena, filepath, &current_data) && DS_Hash64(current_data.Data, current_data.Size) == journaled_hash;
+    arena->SetMark(mark);
+    return already_expanded;
+}
+
+// Usage:
+// PyExpand [options] my_file.cpp [more_files.cpp ...]
+//
+// Options:
+//   --files-from PATH    Also expand the files listed in the text file at PATH, one per line
+//   --journal PATH       Append a line to the progress journal at PATH for every file that has been expanded
+//   --resume             Skip files whose contents match their entry in the progress journal
+//   --python PATH        Path to the python executable (default: the default interpreter of the `py` launcher, cached)
+//   --fast-startup       Start python without PYTHON* environment variables (-E) and without importing `site` until a block needs it
+//   --no-coalesce        Evaluate every block, even if an identical block has already been evaluated in this run
+//                        (by default, blocks with the same code share their result, so they must not depend on anything else)
+//   -j N                 Maximum number of python worker processes (default: number of processors)
+//   --scale-up-ms N      Start another worker when a block has been queued for longer than N milliseconds (default: 10)
+//   --idle-timeout-ms N  Stop a worker after it has been idle for N milliseconds, unless it's the last one (default: 2000)
+//   --recycle-blocks N   Replace a python worker process after it has evaluated N blocks (default: 1000, 0: never)
+//   --recycle-mb N       Replace a python worker process once its working set exceeds N megabytes (default: 1024, 0: never)
+//   --memory-limit-mb N  Make allocations fail in a python worker process once it has committed N megabytes (default: 0, no limit)
+//   --cpu-limit-ms N     Terminate a python worker process if a single block uses more than N milliseconds of CPU time (default: 0, no limit)
+//   --speculate N        Evaluate the blocks of the next N files in the background while expanding the current one (default: 0).
+//                        Has no effect with --no-coalesce.
+//   --batch N            Evaluate up to N small blocks in one round trip to a python worker process (default: 16, 0: no batching).
+//                        Has no effect with --cpu-limit-ms or --profile.
+//   --batch-max-bytes N  Blocks whose python code is at most N bytes long count as small (default: 256)
+//   --stats              Print worker pool statistics at the end
+//   --profile            Print the time and memory usage of each block. Turns off batching.
+int main(int argc, const char** argv)
+{
+    DS_ScopedArena<2048> arena;
+
+    DS_Array<const char*> filepaths(&arena);
+    const char* journal_path = NULL;
+    bool resume = false;
+    bool print_stats = false;
+    int speculate_files = 0;
+    int recycle_after_mb = 1024;
+    int memory_limit_mb = 0;
+    int cpu_limit_ms = 0;
+    ExpandOptions expand_options = {};
+
+    EvaluatorOptions options = {};
+    options.MaxWorkers = OS_GetProcessorCount();
+    options.ScaleUpWaitMs = 10;
+    options.IdleTimeoutMs = 2000;
+    options.RecycleAfterBlocks = 1000;
+    options.CoalesceBlocks = true;
+    options.MaxBatchSize = 16;
+    options.MaxBatchedCodeBytes = 256;
+
+    for (int i = 1; i < argc; i++)
+    {
+        DS_String arg = DS_Str(argv[i]);
+        bool has_value = i + 1 < argc;
+        if (arg == "--python" && has_value)                 options.Interpreter = argv[++i];
+        else if (arg == "--fast-startup")                   options.FastStartup = true;
+        else if (arg == "--no-coalesce")                    options.CoalesceBlocks = false;
+        else if (arg == "-j" && has_value)                  options.MaxWorkers = atoi(argv[++i]);
+        else if (arg == "--scale-up-ms" && has_value)       options.ScaleUpWaitMs = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--idle-timeout-ms" && has_value)   options.IdleTimeoutMs = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--recycle-blocks" && has_value)    options.RecycleAfterBlocks = atoi(argv[++i]);
+        else if (arg == "--recycle-mb" && has_value)        recycle_after_mb = atoi(argv[++i]);
+        else if (arg == "--memory-limit-mb" && has_value)   memory_limit_mb = atoi(argv[++i]);
+        else if (arg == "--cpu-limit-ms" && has_value)      cpu_limit_ms = atoi(argv[++i]);
+        else if (arg == "--journal" && has_value)           journal_path = argv[++i];
+        else if (arg == "--resume")                         resume = true;
+        else if (arg == "--speculate" && has_value)         speculate_files = atoi(argv[++i]);
+        else if (arg == "--batch" && has_value)             options.MaxBatchSize = atoi(argv[++i]);
+        else if (arg == "--batch-max-bytes" && has_value)   options.MaxBatchedCodeBytes = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--stats")                          print_stats = true;
+        else if (arg == "--profile")                        expand_options.PrintProfile = options.MeasureEachBlock = true;
+        else if (arg == "--files-from" && has_value)
+        {
+            const char* list_path = argv[++i];
+            DS_StringView list;
+            if (!OS_ReadEntireFile(&arena, list_path, &list))
+            {
+                printf("Failed to read file '%s'!\n", list_path);
+                return 1;
+            }
+            while (list.Size > 0)
+            {
+                DS_StringView line = list.Split("\n");
+                if (line.Size > 0 && line.Data[line.Size - 1] == '\r')
+                    line.Size -= 1;
+                if (line.Size > 0)
+                    filepaths.Add(line.ToCStr(&arena));
+            }
+        }
+        else if (arg.Size > 0 && arg.Data[0] != '-')
+            filepaths.Add(argv[i]);
+        else
+        {
+            printf("Unexpected argument '%s'!\n", argv[i]);
             return 1;
         }
-        printf("Python exit code: %d\n", exit_code);
-        printf("Python exit str: %s\n", print_callback.Result.CStr());
+    }
 
-        DS_StringView python_result = print_callback.Result;
-        if (python_result.Slice(python_result.Size - 2) == "\r\n")
-            python_result = python_result.Slice(0, python_result.Size - 2);
+    if (filepaths.Size == 0)
+    {
+        printf("Please provide the file name as an argument!\n");
+        return 1;
+    }
 
-        python_results.Add(python_result);
+    if (resume && journal_path == NULL)
+    {
+        printf("--resume requires a --journal!\n");
+        return 1;
     }
-    
-    OS_DeleteFile("__pyexpand_temp.py");
 
+    DS_Map<uint64_t, uint64_t> journal_entries;
+    journal_entries.Init(&arena);
+    if (resume)
+        LoadJournal(&arena, journal_path, &journal_entries);
+
+    options.RecycleAfterBytes = (uint64_t)recycle_after_mb * 1024 * 1024;
+    options.MemoryLimitBytes = (uint64_t)memory_limit_mb * 1024 * 1024;
+    options.CPUTimeLimitUs = (uint64_t)cpu_limit_ms * 1000;
+
+    Evaluator* evaluator = StartEvaluator(options);
+    if (!evaluator)
+        return 1;
+
+    int num_failed = 0;
+    int num_skipped = 0;
+    for (int i = 0; i < filepaths.Size; i++)
     {
-        DS_DynamicString result(&arena);
+        const char* filepath = filepaths[i];
+        DS_ArenaMark mark = arena.GetMark();
 
-        for (int i = 0; i < ranges_to_keep.Size; i++)
+        // Keep the speculation `speculate_files` files ahead of the file being expanded. The explicit evaluation of the current
+        // file has priority, so speculative blocks only run on workers that would otherwise be idle.
+        if (speculate_files > 0)
         {
-            if (i > 0)
+            for (int j = i == 0 ? 1 : i + speculate_files; j <= i + speculate_files && j < filepaths.Size; j++)
             {
-                DS_StringView python_string = python_results[i - 1];
-                int indent = 0;
-                for (; indent < python_string.Size; indent++)
-                    if (python_string.Data[indent] != ' ' && python_string.Data[indent] != '\t')
-                        break;
-                DS_StringView indent_str = python_string.Slice(0, python_strings_is_multiline[i - 1] ? indent : 0);
-
-                result.Add(python_strings_is_multiline[i - 1] ? "\n" : " ");
-                result.Add(python_results[i - 1]);
-                result.Add(python_strings_is_multiline[i - 1] ? "\n" : " ");
-                result.Add(indent_str);
+                if (!(resume && IsAlreadyExpanded(&arena, &journal_entries, filepaths[j])))
+                    SpeculateFile(&arena, evaluator, filepaths[j]);
             }
-            result.Add(ranges_to_keep[i]);
         }
 
-        FILE* f = fopen(filepath, "wb");
-        if (!f)
+        uint64_t output_hash;
+        if (resume && IsAlreadyExpanded(&arena, &journal_entries, filepath))
+            num_skipped += 1;
+        else if (ExpandFile(&arena, evaluator, expand_options, filepath, &output_hash))
         {
-            printf("Failed to open the target file for writing the result!\n");
-            return 1;
+            if (journal_path && !AppendToJournal(journal_path, filepath, output_hash))
+            {
+                printf("Failed to write to the journal '%s'!\n", journal_path);
+                num_failed += 1;
+            }
         }
-        fprintf(f, "%s", result.CStr());
+        else
+            num_failed += 1;
 
-        fclose(f);
+        // Drop what's left of the file's speculation, e.g. blocks that changed before the file was expanded
+        if (speculate_files > 0)
+            SpeculateBlocks(evaluator, FilePathKey(DS_Str(filepath)), {});
+
+        arena.SetMark(mark);
     }
 
-    return 0;
-}
\ No newline at end of file
+    if (filepaths.Size > 1)
+        printf("Expanded %lld files, skipped %d already expanded files, %d failed.\n", (long long)(filepaths.Size - num_skipped - num_failed), num_skipped, num_failed);
+
+    if (print_stats)
+        PrintEvaluatorStats(evaluator);
+
+    StopEvaluator(evaluator);
+    return num_failed == 0 ? 0 : 1;
+}
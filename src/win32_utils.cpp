@@ -1,7 +1,9 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include "ds/ds.h"
 
 #include "win32_utils.h"
 #include <Windows.h>
+#include <Psapi.h>
 
 wchar_t* OS_UTF8ToWide(DS_Arena* arena, DS_StringView str, int null_terminations)
 {
@@ -16,6 +18,15 @@ wchar_t* OS_UTF8ToWide(DS_Arena* arena, DS_StringView str, int null_terminations
 	return result;
 }
 
+char* OS_WideToUTF8(DS_Arena* arena, const wchar_t* str)
+{
+	int size = WideCharToMultiByte(CP_UTF8, 0, str, -1, NULL, 0, NULL, NULL); // includes the null termination
+	char* result = arena->PushUninitialized(size > 0 ? size : 1);
+	if (size > 0) WideCharToMultiByte(CP_UTF8, 0, str, -1, result, size, NULL, NULL);
+	else result[0] = 0;
+	return result;
+}
+
 bool OS_RunConsoleCommand(DS_StringView command_string, bool wait_for_finish, uint32_t* out_exit_code, OS_RunProcessPrintCallback* print)
 {
 	DS_ScopedArena<1024> temp;
@@ -89,6 +100,206 @@ bool OS_RunConsoleCommand(DS_StringView command_string, bool wait_for_finish, ui
 	return ok;
 }
 
+static bool OS_SetJobLimits(HANDLE job, uint64_t memory_limit_bytes, uint64_t user_time_limit_us)
+{
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION info = {0};
+	info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+	if (memory_limit_bytes > 0)
+	{
+		info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+		info.ProcessMemoryLimit = (SIZE_T)memory_limit_bytes;
+	}
+	if (user_time_limit_us > 0)
+	{
+		info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_TIME;
+		info.BasicLimitInformation.PerProcessUserTimeLimit.QuadPart = (LONGLONG)user_time_limit_us * 10; // in 100-nanosecond ticks
+	}
+	return SetInformationJobObject(job, JobObjectExtendedLimitInformation, &info, sizeof(info));
+}
+
+// Child processes inherit every inheritable handle that exists at the time of CreateProcessW, including the pipe ends of other
+// children that are being started concurrently from another thread. A child holding on to another child's pipe would keep it
+// from ever reporting a broken pipe, so processes are started one at a time.
+static SRWLOCK OS_StartProcessLock = SRWLOCK_INIT;
+
+bool OS_StartProcess(DS_StringView command_string, OS_Process* out_process)
+{
+	DS_ScopedArena<1024> temp;
+	wchar_t* command_string_wide = OS_UTF8ToWide(&temp, command_string, 1); // NOTE: CreateProcessW may write to command_string_wide in place!
+
+	SECURITY_ATTRIBUTES security_attrs = {0};
+	security_attrs.nLength = sizeof(SECURITY_ATTRIBUTES);
+	security_attrs.lpSecurityDescriptor = NULL;
+	security_attrs.bInheritHandle = 1;
+
+	HANDLE IN_Rd = NULL, IN_Wr = NULL;
+	HANDLE OUT_Rd = NULL, OUT_Wr = NULL;
+
+	AcquireSRWLockExclusive(&OS_StartProcessLock);
+
+	bool ok = true;
+	if (ok) ok = CreatePipe(&IN_Rd, &IN_Wr, &security_attrs, 0);
+	if (ok) ok = CreatePipe(&OUT_Rd, &OUT_Wr, &security_attrs, 0);
+	if (ok) ok = SetHandleInformation(IN_Wr, HANDLE_FLAG_INHERIT, 0);
+	if (ok) ok = SetHandleInformation(OUT_Rd, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFOW startup_info = {0};
+	startup_info.cb = sizeof(STARTUPINFOW);
+	startup_info.dwFlags = STARTF_USESTDHANDLES;
+	startup_info.hStdInput = IN_Rd;
+	startup_info.hStdOutput = OUT_Wr;
+	startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+	// The process is started suspended, so that it can't start any child processes before it's been assigned to the job.
+	// Child processes then automatically belong to the same job. This matters because the `py` launcher runs python in a child process.
+	HANDLE job = CreateJobObjectW(NULL, NULL);
+	if (job == NULL) ok = false;
+	if (ok) ok = OS_SetJobLimits(job, 0, 0);
+
+	PROCESS_INFORMATION process_info = {0};
+	if (ok) ok = CreateProcessW(NULL, command_string_wide, NULL, NULL, true, CREATE_UNICODE_ENVIRONMENT | CREATE_SUSPENDED, NULL, NULL, &startup_info, &process_info);
+	if (ok)
+	{
+		ok = AssignProcessToJobObject(job, process_info.hProcess);
+		if (ok) ResumeThread(process_info.hThread);
+		else TerminateProcess(process_info.hProcess, 1);
+	}
+
+	// The child process has its own copies of these handles now. Closing ours lets reads from the stdout pipe fail instead
+	// of blocking forever if the process exits.
+	if (IN_Rd) CloseHandle(IN_Rd);
+	if (OUT_Wr) CloseHandle(OUT_Wr);
+
+	ReleaseSRWLockExclusive(&OS_StartProcessLock);
+
+	if (ok)
+	{
+		CloseHandle(process_info.hThread);
+		out_process->Handle = process_info.hProcess;
+		out_process->Job = job;
+		out_process->StdinWrite = IN_Wr;
+		out_process->StdoutRead = OUT_Rd;
+	}
+	else
+	{
+		if (process_info.hProcess) CloseHandle(process_info.hProcess);
+		if (process_info.hThread) CloseHandle(process_info.hThread);
+		if (job) CloseHandle(job);
+		if (IN_Wr) CloseHandle(IN_Wr);
+		if (OUT_Rd) CloseHandle(OUT_Rd);
+	}
+	return ok;
+}
+
+bool OS_SetProcessLimits(OS_Process* process, uint64_t memory_limit_bytes, uint64_t user_time_limit_us)
+{
+	return OS_SetJobLimits((HANDLE)process->Job, memory_limit_bytes, user_time_limit_us);
+}
+
+bool OS_WriteToProcess(OS_Process* process, const void* data, size_t size)
+{
+	const char* ptr = (const char*)data;
+	while (size > 0)
+	{
+		DWORD chunk_size = size > (1u << 30) ? (1u << 30) : (DWORD)size;
+		DWORD num_written;
+		if (!WriteFile((HANDLE)process->StdinWrite, ptr, chunk_size, &num_written, NULL)) return false;
+		ptr += num_written;
+		size -= num_written;
+	}
+	return true;
+}
+
+bool OS_ReadFromProcess(OS_Process* process, void* data, size_t size)
+{
+	char* ptr = (char*)data;
+	while (size > 0)
+	{
+		DWORD chunk_size = size > (1u << 30) ? (1u << 30) : (DWORD)size;
+		DWORD num_read;
+		if (!ReadFile((HANDLE)process->StdoutRead, ptr, chunk_size, &num_read, NULL) || num_read == 0) return false;
+		ptr += num_read;
+		size -= num_read;
+	}
+	return true;
+}
+
+bool OS_PeekProcessOutput(OS_Process* process, bool* out_has_output)
+{
+	// PeekNamedPipe fails once the pipe is empty and its write end is closed. If the process has exited, but a child process still
+	// holds the write end, nothing will be written anymore either.
+	DWORD num_available = 0;
+	bool pipe_ok = PeekNamedPipe((HANDLE)process->StdoutRead, NULL, 0, NULL, &num_available, NULL);
+	*out_has_output = pipe_ok && num_available > 0;
+	return *out_has_output || (pipe_ok && WaitForSingleObject((HANDLE)process->Handle, 0) == WAIT_TIMEOUT);
+}
+
+void OS_CloseProcess(OS_Process* process, bool wait_for_exit)
+{
+	CloseHandle((HANDLE)process->StdinWrite);
+	if (wait_for_exit)
+		WaitForSingleObject((HANDLE)process->Handle, INFINITE);
+
+	CloseHandle((HANDLE)process->StdoutRead);
+	CloseHandle((HANDLE)process->Handle);
+	CloseHandle((HANDLE)process->Job); // Kills the process if it's still running
+	*process = {};
+}
+
+static uint64_t OS_FileTimeToMicroseconds(FILETIME time)
+{
+	ULARGE_INTEGER ticks;
+	ticks.LowPart = time.dwLowDateTime;
+	ticks.HighPart = time.dwHighDateTime;
+	return ticks.QuadPart / 10; // from 100-nanosecond ticks
+}
+
+bool OS_GetProcessUsage(uint32_t process_id, OS_ProcessUsage* out_usage)
+{
+	HANDLE handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, false, process_id);
+	if (handle == NULL)
+		return false;
+
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	PROCESS_MEMORY_COUNTERS counters = {0};
+	bool ok = GetProcessTimes(handle, &creation_time, &exit_time, &kernel_time, &user_time);
+	if (ok) ok = GetProcessMemoryInfo(handle, &counters, sizeof(counters));
+	CloseHandle(handle);
+
+	if (ok)
+	{
+		out_usage->UserTimeUs = OS_FileTimeToMicroseconds(user_time);
+		out_usage->KernelTimeUs = OS_FileTimeToMicroseconds(kernel_time);
+		out_usage->WorkingSet = counters.WorkingSetSize;
+		out_usage->PeakWorkingSet = counters.PeakWorkingSetSize;
+	}
+	return ok;
+}
+
+bool OS_ReadEntireFile(DS_Arena* arena, const char* filepath, DS_StringView* out_data)
+{
+	FILE* f = NULL;
+	errno_t err = fopen_s(&f, filepath, "rb");
+	if (!f)
+		return false;
+
+	// ftell returns a 32-bit long on Windows, so use the 64-bit versions to support files over 2 GB.
+	_fseeki64(f, 0, SEEK_END);
+	int64_t fsize = _ftelli64(f);
+	_fseeki64(f, 0, SEEK_SET);
+
+	bool ok = fsize >= 0;
+	if (ok)
+	{
+		char* data = arena->PushUninitialized((size_t)fsize);
+		ok = fread(data, 1, (size_t)fsize, f) == (size_t)fsize;
+		*out_data = {data, (intptr_t)fsize};
+	}
+
+	fclose(f);
+	return ok;
+}
+
 bool OS_DeleteFile(const char* filepath)
 {
 	DS_ScopedArena<1024> temp;
@@ -96,3 +307,273 @@ bool OS_DeleteFile(const char* filepath)
 	BOOL ok = DeleteFileW(filepath_wide);
 	return (bool)ok;
 }
+
+uint32_t OS_GetCurrentProcessID()
+{
+	return GetCurrentProcessId();
+}
+
+bool OS_LockFile(const char* filepath, OS_FileLock* out_lock)
+{
+	DS_ScopedArena<1024> temp;
+	DS_DynamicString lock_filepath(&temp);
+	lock_filepath.Addf("%s.lock", filepath);
+	wchar_t* lock_filepath_wide = OS_UTF8ToWide(&temp, lock_filepath, 1);
+
+	ULONGLONG start_time = GetTickCount64();
+	for (;;)
+	{
+		// Opening the lock file without any share flags fails while some other process has it open. When that process closes it,
+		// the file is deleted, which can also make the open fail for a moment with ERROR_ACCESS_DENIED while the deletion is pending.
+		HANDLE handle = CreateFileW(lock_filepath_wide, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			out_lock->Handle = handle;
+			return true;
+		}
+
+		// A pending deletion is over quickly, so an access denial that lasts longer is real, e.g. a read-only directory.
+		DWORD error = GetLastError();
+		ULONGLONG waited_ms = GetTickCount64() - start_time;
+		if (error == ERROR_ACCESS_DENIED && waited_ms >= OS_LOCK_FILE_ACCESS_DENIED_TIMEOUT_MS)
+			return false;
+		if (error != ERROR_SHARING_VIOLATION && error != ERROR_ACCESS_DENIED)
+			return false;
+		if (waited_ms >= OS_LOCK_FILE_TIMEOUT_MS)
+			return false;
+
+		Sleep(1);
+	}
+}
+
+void OS_UnlockFile(OS_FileLock* lock)
+{
+	CloseHandle((HANDLE)lock->Handle);
+	lock->Handle = NULL;
+}
+
+struct OS_ThreadStart {
+	void (*Fn)(void* arg);
+	void* Arg;
+};
+
+static DWORD WINAPI OS_ThreadProc(LPVOID param)
+{
+	OS_ThreadStart start = *(OS_ThreadStart*)param;
+	DS_HeapAllocator()->MemFree(param);
+	start.Fn(start.Arg);
+	return 0;
+}
+
+bool OS_StartThread(OS_Thread* out_thread, void (*fn)(void* arg), void* arg)
+{
+	OS_ThreadStart* start = (OS_ThreadStart*)DS_HeapAllocator()->MemAlloc(sizeof(OS_ThreadStart));
+	start->Fn = fn;
+	start->Arg = arg;
+
+	HANDLE handle = CreateThread(NULL, 0, OS_ThreadProc, start, 0, NULL);
+	if (handle == NULL)
+	{
+		DS_HeapAllocator()->MemFree(start);
+		return false;
+	}
+
+	out_thread->Handle = handle;
+	return true;
+}
+
+void OS_JoinThread(OS_Thread* thread)
+{
+	WaitForSingleObject((HANDLE)thread->Handle, INFINITE);
+	CloseHandle((HANDLE)thread->Handle);
+	thread->Handle = NULL;
+}
+
+void OS_MutexLock(OS_Mutex* mutex)
+{
+	AcquireSRWLockExclusive((SRWLOCK*)&mutex->Lock);
+}
+
+void OS_MutexUnlock(OS_Mutex* mutex)
+{
+	ReleaseSRWLockExclusive((SRWLOCK*)&mutex->Lock);
+}
+
+bool OS_ConditionVariableWait(OS_ConditionVariable* cv, OS_Mutex* mutex, uint32_t timeout_ms)
+{
+	return SleepConditionVariableSRW((CONDITION_VARIABLE*)&cv->Ptr, (SRWLOCK*)&mutex->Lock, timeout_ms, 0);
+}
+
+void OS_ConditionVariableSignal(OS_ConditionVariable* cv)
+{
+	WakeConditionVariable((CONDITION_VARIABLE*)&cv->Ptr);
+}
+
+void OS_ConditionVariableBroadcast(OS_ConditionVariable* cv)
+{
+	WakeAllConditionVariable((CONDITION_VARIABLE*)&cv->Ptr);
+}
+
+uint64_t OS_GetTimeMicroseconds()
+{
+	static LARGE_INTEGER frequency = {};
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+int OS_GetProcessorCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+bool OS_RenameFile(const char* filepath, const char* new_filepath)
+{
+	DS_ScopedArena<1024> temp;
+	wchar_t* filepath_wide = OS_UTF8ToWide(&temp, DS_Str(filepath), 1);
+	wchar_t* new_filepath_wide = OS_UTF8ToWide(&temp, DS_Str(new_filepath), 1);
+	return MoveFileExW(filepath_wide, new_filepath_wide, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+bool OS_WriteFileAtomically(const char* filepath, DS_StringView data)
+{
+	DS_ScopedArena<1024> temp;
+	DS_DynamicString temp_filepath(&temp);
+	temp_filepath.Addf("%s.%u.tmp", filepath, OS_GetCurrentProcessID());
+
+	FILE* f = fopen(temp_filepath.CStr(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(data.Data, 1, data.Size, f) == (size_t)data.Size;
+	ok = fclose(f) == 0 && ok;
+
+	ok = ok && OS_RenameFile(temp_filepath.CStr(), filepath);
+	if (!ok)
+		OS_DeleteFile(temp_filepath.CStr());
+	return ok;
+}
+
+bool OS_OpenFileForPatching(const char* filepath, OS_File* out_file)
+{
+	DS_ScopedArena<1024> temp;
+	wchar_t* filepath_wide = OS_UTF8ToWide(&temp, DS_Str(filepath), 1);
+
+	HANDLE handle = CreateFileW(filepath_wide, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	out_file->Handle = handle;
+	return true;
+}
+
+bool OS_WriteFileAt(OS_File* file, uint64_t offset, const void* data, size_t size)
+{
+	// For a synchronous handle, the offset in OVERLAPPED makes WriteFile write at that position, like pwrite.
+	const char* remaining = (const char*)data;
+	while (size > 0)
+	{
+		DWORD chunk_size = size > (1u << 30) ? (1u << 30) : (DWORD)size;
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD written;
+		if (!WriteFile((HANDLE)file->Handle, remaining, chunk_size, &written, &overlapped) || written == 0)
+			return false;
+
+		remaining += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+void OS_CloseFile(OS_File* file)
+{
+	CloseHandle((HANDLE)file->Handle);
+	file->Handle = NULL;
+}
+
+bool OS_MapFile(const char* filepath, OS_MappedFile* out_file)
+{
+	DS_ScopedArena<1024> temp;
+	wchar_t* filepath_wide = OS_UTF8ToWide(&temp, DS_Str(filepath), 1);
+
+	// FILE_SHARE_DELETE lets the file be replaced with OS_WriteFileAtomically while it's mapped
+	HANDLE file = CreateFileW(filepath_wide, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	out_file->Data = DS_StringView((const char*)data, (intptr_t)size.QuadPart);
+	out_file->FileHandle = file;
+	out_file->MappingHandle = mapping;
+	return true;
+}
+
+void OS_UnmapFile(OS_MappedFile* file)
+{
+	UnmapViewOfFile(file->Data.Data);
+	CloseHandle((HANDLE)file->MappingHandle);
+	CloseHandle((HANDLE)file->FileHandle);
+	*file = {};
+}
+
+bool OS_GetFileStamp(const char* filepath, uint64_t* out_size, uint64_t* out_modtime)
+{
+	DS_ScopedArena<1024> temp;
+	wchar_t* filepath_wide = OS_UTF8ToWide(&temp, DS_Str(filepath), 1);
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(filepath_wide, GetFileExInfoStandard, &attributes))
+		return false;
+
+	*out_size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	*out_modtime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool OS_GetCacheDirectory(DS_Arena* arena, const char* app_name, DS_String* out_path)
+{
+	wchar_t local_app_data[MAX_PATH];
+	DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", local_app_data, MAX_PATH);
+	if (length == 0 || length >= MAX_PATH)
+		return false;
+
+	DS_DynamicString path(arena);
+	path.Addf("%s\\%s", OS_WideToUTF8(arena, local_app_data), app_name);
+
+	wchar_t* path_wide = OS_UTF8ToWide(arena, path, 1);
+	if (!CreateDirectoryW(path_wide, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+		return false;
+
+	*out_path = path;
+	return true;
+}
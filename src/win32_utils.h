@@ -6,4 +6,131 @@ struct OS_RunProcessPrintCallback {
 // NOTE: command_string may be modified by OS_RunCommand! Internally, CreateProcessW may write to it.
 bool OS_RunConsoleCommand(DS_StringView command_string, bool wait_for_finish, uint32_t* out_exit_code = NULL, OS_RunProcessPrintCallback* print = NULL);
 
+struct OS_Process {
+	void* Handle;
+	void* Job; // The process and all of its child processes belong to this job object.
+	void* StdinWrite;
+	void* StdoutRead;
+};
+
+// Starts a process with pipes connected to its stdin and stdout, without waiting for it to finish. Its stderr is inherited from this process.
+// The process and its children are killed if this process exits before calling OS_CloseProcess.
+bool OS_StartProcess(DS_StringView command_string, OS_Process* out_process);
+
+// Limits the memory that the process and each of its child processes may commit, and the total user mode CPU time that each of them
+// may use during their lifetime. Allocations over the memory limit fail, while processes exceeding the CPU time limit are terminated.
+// A limit of 0 means no limit.
+bool OS_SetProcessLimits(OS_Process* process, uint64_t memory_limit_bytes, uint64_t user_time_limit_us);
+
+// Writes all of `data` into the stdin of the process.
+bool OS_WriteToProcess(OS_Process* process, const void* data, size_t size);
+
+// Reads exactly `size` bytes from the stdout of the process. Returns false if the process closes its stdout before that.
+bool OS_ReadFromProcess(OS_Process* process, void* data, size_t size);
+
+// Sets `out_has_output` to whether the process has written output that can be read without blocking. Returns false if there's no
+// output left and none can come anymore, because the process has exited or closed its stdout.
+bool OS_PeekProcessOutput(OS_Process* process, bool* out_has_output);
+
+// Closes the stdin of the process and releases the handles to it. If `wait_for_exit` is true, waits for the process to exit first.
+void OS_CloseProcess(OS_Process* process, bool wait_for_exit);
+
+struct OS_ProcessUsage {
+	uint64_t UserTimeUs;
+	uint64_t KernelTimeUs;
+	uint64_t WorkingSet;     // Resident memory in bytes
+	uint64_t PeakWorkingSet; // Over the lifetime of the process
+};
+
+bool OS_GetProcessUsage(uint32_t process_id, OS_ProcessUsage* out_usage);
+
+// The data is allocated from `arena`.
+bool OS_ReadEntireFile(DS_Arena* arena, const char* filepath, DS_StringView* out_data);
+
 bool OS_DeleteFile(const char* filepath);
+
+// Replaces `new_filepath` if it exists. When both paths are on the same volume, the file is replaced atomically.
+bool OS_RenameFile(const char* filepath, const char* new_filepath);
+
+// Writes `data` to a temporary file next to `filepath` and renames it over `filepath`, so that nobody sees a partially written file.
+bool OS_WriteFileAtomically(const char* filepath, DS_StringView data);
+
+struct OS_File {
+	void* Handle;
+};
+
+// Opens an existing file for writing at arbitrary offsets. The file isn't truncated.
+bool OS_OpenFileForPatching(const char* filepath, OS_File* out_file);
+
+bool OS_WriteFileAt(OS_File* file, uint64_t offset, const void* data, size_t size);
+
+void OS_CloseFile(OS_File* file);
+
+struct OS_MappedFile {
+	DS_StringView Data;
+	void* FileHandle;
+	void* MappingHandle;
+};
+
+// Maps the whole file into memory for reading. The pages are only read from disk when they are touched, so this is the fastest way
+// to open large files of which only a part is used. Writing to the data is an access violation. Empty files can't be mapped.
+bool OS_MapFile(const char* filepath, OS_MappedFile* out_file);
+
+void OS_UnmapFile(OS_MappedFile* file);
+
+// The stamp of a file is its size and last modification time.
+bool OS_GetFileStamp(const char* filepath, uint64_t* out_size, uint64_t* out_modtime);
+
+// Returns the directory for app-specific cache files (%LOCALAPPDATA%\<app_name>), creating it if needed.
+bool OS_GetCacheDirectory(DS_Arena* arena, const char* app_name, DS_String* out_path);
+
+uint32_t OS_GetCurrentProcessID();
+
+struct OS_FileLock {
+	void* Handle;
+};
+
+// How long OS_LockFile waits for another process to release the lock, and for an access denial to go away
+#define OS_LOCK_FILE_TIMEOUT_MS 60000
+#define OS_LOCK_FILE_ACCESS_DENIED_TIMEOUT_MS 1000
+
+// Takes an exclusive lock on `filepath` that is shared between processes, blocking until the lock is acquired.
+// Returns false if the lock file can't be created, or if the lock isn't acquired within OS_LOCK_FILE_TIMEOUT_MS.
+// The lock is advisory: it only excludes other processes that call OS_LockFile on the same path. Internally, it holds
+// a `<filepath>.lock` file open, which is deleted when the lock is released or the process exits.
+bool OS_LockFile(const char* filepath, OS_FileLock* out_lock);
+
+void OS_UnlockFile(OS_FileLock* lock);
+
+struct OS_Thread {
+	void* Handle;
+};
+
+bool OS_StartThread(OS_Thread* out_thread, void (*fn)(void* arg), void* arg);
+
+// Waits for the thread to finish and releases the handle to it.
+void OS_JoinThread(OS_Thread* thread);
+
+// A zero-initialized OS_Mutex is unlocked and ready to use. It must not be locked recursively.
+struct OS_Mutex {
+	void* Lock;
+};
+
+void OS_MutexLock(OS_Mutex* mutex);
+void OS_MutexUnlock(OS_Mutex* mutex);
+
+// A zero-initialized OS_ConditionVariable is ready to use.
+struct OS_ConditionVariable {
+	void* Ptr;
+};
+
+// Atomically unlocks the mutex and waits for the condition variable to be signaled, then locks the mutex again.
+// Returns false if the wait timed out. Like with any condition variable, spurious wakeups are possible.
+bool OS_ConditionVariableWait(OS_ConditionVariable* cv, OS_Mutex* mutex, uint32_t timeout_ms);
+void OS_ConditionVariableSignal(OS_ConditionVariable* cv);
+void OS_ConditionVariableBroadcast(OS_ConditionVariable* cv);
+
+// Monotonic time
+uint64_t OS_GetTimeMicroseconds();
+
+int OS_GetProcessorCount();
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <vector> // std::vector<bool>, to compare against
+
+#include "src/ds/ds.h"
+
+#include "tests.h"
+
+// Compares DS_BitSet with std::vector<bool> after random changes and bulk operations. Most sizes aren't multiples of 64 or 128, so the
+// last word is only partly used, and the bulk operations end with an odd word after the pairs of words that SSE2 processes.
+
+static bool BitSetMatches(const DS_BitSet& set, const std::vector<bool>& expected)
+{
+	intptr_t n = (intptr_t)expected.size();
+	if (set.NumBits != n)
+		return false;
+
+	intptr_t count = 0;
+	for (intptr_t i = 0; i < n; i++)
+	{
+		if (set.Get(i) != expected[i])
+			return false;
+		count += expected[i];
+	}
+
+	// The unused bits of the last word must stay zero, since Count and FindNextSet rely on it
+	if (n % 64 != 0 && (set.Words[n / 64] >> (n % 64)) != 0)
+		return false;
+	if (set.Count() != count)
+		return false;
+
+	// The next set and clear bit from every position
+	intptr_t next_set = n, next_clear = n;
+	for (intptr_t i = n - 1; i >= -1; i--)
+	{
+		if (set.FindNextSet(i + 1) != next_set || set.FindNextClear(i + 1) != next_clear)
+			return false;
+		if (i >= 0)
+			(expected[i] ? next_set : next_clear) = i;
+	}
+	return true;
+}
+
+// Sets each bit with the given probability out of 8, in both sets
+static void RandomizeBitSet(DS_BitSet* set, std::vector<bool>* expected, uint64_t eighths, TestRandom* random)
+{
+	for (intptr_t i = 0; i < set->NumBits; i++)
+	{
+		bool bit = random->Next() % 8 < eighths;
+		(*expected)[i] = bit;
+		if (bit) set->Set(i);
+		else set->Clear(i);
+	}
+}
+
+void TestBitSet()
+{
+	static const intptr_t sizes[] = { 0, 1, 2, 63, 64, 65, 127, 128, 129, 191, 192, 193, 255, 1000, 1087 };
+	TestRandom random = { 7 };
+
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		intptr_t n = sizes[s];
+		DS_BitSet set, other;
+		set.Init(n);
+		other.Init(n);
+		std::vector<bool> expected(n, false), other_expected(n, false);
+
+		bool ok = TEST_CHECK(BitSetMatches(set, expected));
+
+		// Sparse, half full and dense sets, so that FindNextSet and FindNextClear skip whole words
+		for (uint64_t eighths = 1; eighths < 8 && ok; eighths += 3)
+		{
+			RandomizeBitSet(&set, &expected, eighths, &random);
+			ok = TEST_CHECK(BitSetMatches(set, expected));
+		}
+
+		set.SetAll();
+		expected.assign(n, true);
+		ok = ok && TEST_CHECK(BitSetMatches(set, expected));
+		set.ClearAll();
+		expected.assign(n, false);
+		ok = ok && TEST_CHECK(BitSetMatches(set, expected));
+
+		// The bulk operations, starting from a full set, so that a bit that's wrongly set past the end would show up
+		for (int op = 0; op < 3 && ok; op++)
+		{
+			for (int round = 0; round < 2 && ok; round++)
+			{
+				if (round == 0)
+				{
+					set.SetAll();
+					expected.assign(n, true);
+				}
+				else
+					RandomizeBitSet(&set, &expected, 4, &random);
+				RandomizeBitSet(&other, &other_expected, 4, &random);
+
+				for (intptr_t i = 0; i < n; i++)
+				{
+					switch (op)
+					{
+					case 0: expected[i] = expected[i] && other_expected[i]; break;
+					case 1: expected[i] = expected[i] || other_expected[i]; break;
+					case 2: expected[i] = expected[i] && !other_expected[i]; break;
+					}
+				}
+				if (op == 0) set.And(other);
+				if (op == 1) set.Or(other);
+				if (op == 2) set.AndNot(other);
+
+				static const char* op_names[] = { "And", "Or", "AndNot" };
+				ok = TEST_CHECK(BitSetMatches(set, expected) && BitSetMatches(other, other_expected));
+				if (!ok)
+					printf("  %s of %lld bits\n", op_names[op], (long long)n);
+			}
+		}
+
+		// Shrinking clears the bits past the new end, so growing again adds cleared bits
+		set.SetAll();
+		intptr_t smaller = n / 2 + 1;
+		set.Resize(smaller);
+		set.Resize(n + 70);
+		expected.assign(n + 70, false);
+		for (intptr_t i = 0; i < smaller && i < n; i++)
+			expected[i] = true;
+		if (!TEST_CHECK(BitSetMatches(set, expected)))
+			printf("  Resize from %lld to %lld to %lld bits\n", (long long)n, (long long)smaller, (long long)(n + 70));
+
+		if (!ok)
+			printf("  with %lld bits\n", (long long)n);
+		set.Deinit();
+		other.Deinit();
+	}
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/block_parser.h"
+#include "tests.h"
+
+// Tests the parsing of python blocks: FindMarker against a byte-by-byte search, the choice of the comment syntax by file name, and
+// which named blocks each block depends on. The evaluation of named blocks is tested in test_named_blocks.cpp.
+
+static intptr_t ReferenceFindMarker(DS_StringView text, intptr_t start_from, DS_StringView marker)
+{
+	for (intptr_t i = start_from; i + marker.Size <= text.Size; i++)
+	{
+		if (memcmp(text.Data + i, marker.Data, marker.Size) == 0)
+			return i;
+	}
+	return text.Size;
+}
+
+// Searches random text made of the marker's characters from every start offset. Short texts are only searched by the byte-by-byte
+// tail loop, and longer ones end in it, so every size up to a few chunks is tried.
+template<size_t N>
+static void CheckFindMarker(const char (&marker)[N], TestRandom* random)
+{
+	DS_StringView marker_view(marker, N - 1);
+	DS_Array<char> text;
+	text.Init();
+
+	for (intptr_t size = 0; size <= 64; size++)
+	{
+		for (int round = 0; round < 8; round++)
+		{
+			// Mostly the marker's own characters, so that there are many partial matches
+			text.Clear();
+			for (intptr_t i = 0; i < size; i++)
+			{
+				uint64_t r = random->Next();
+				text.Add(r % 4 == 0 ? 'a' : marker[(r >> 8) % (N - 1)]);
+			}
+			DS_StringView view(text.Data, text.Size);
+
+			bool ok = true;
+			for (intptr_t start = 0; start <= size && ok; start++)
+				ok = FindMarker(view, start, marker) == ReferenceFindMarker(view, start, marker_view);
+			if (!TEST_CHECK(ok))
+				printf("  FindMarker of \"%s\" in %lld bytes\n", marker, (long long)size);
+		}
+
+		// The marker at the very end of the text, and cut off by the end of the text
+		text.Clear();
+		text.Resize(size, 'a');
+		text.AddSlice(marker_view);
+		if (!TEST_CHECK(FindMarker(DS_StringView(text.Data, text.Size), 0, marker) == size))
+			printf("  FindMarker of \"%s\" at the end of %lld bytes\n", marker, (long long)text.Size);
+		text.PopBack();
+		TEST_CHECK(FindMarker(DS_StringView(text.Data, text.Size), 0, marker) == text.Size);
+	}
+
+	text.Deinit();
+}
+
+static void TestFindMarker(TestRandom* random)
+{
+	CheckFindMarker("*/", random);
+	CheckFindMarker("/*.py", random);
+	CheckFindMarker("'''.py", random);
+	CheckFindMarker("--[[.py", random);
+	CheckFindMarker("#.end", random);
+}
+
+// Text with one block in each comment syntax, so that the syntax a parser uses can be told by the block that it finds
+static const DS_StringView ALL_SYNTAXES_TEXT = "/*.py 1 */ #[[.py 2 ]] --[[.py 3 ]] '''.py 4 '''";
+
+static void TestGetFileParser()
+{
+	struct FileSyntaxCase
+	{
+		const char* Path;
+		DS_StringView Source; // The source of the block that the file's syntax finds in ALL_SYNTAXES_TEXT
+	};
+	static const FileSyntaxCase cases[] = {
+		{ "a.c", " 1 " },
+		{ "dir/A.CPP", " 1 " },
+		{ "schema.sql", " 1 " },
+		{ "shader.hlsl", " 1 " },
+		{ "no_extension", " 1 " },
+		{ "py", " 1 " },
+		{ "a.py.txt", " 1 " },
+		{ "a.cmake", " 2 " },
+		{ "dir/CMakeLists.txt", " 2 " },
+		{ "dir\\cmakelists.TXT", " 2 " },
+		{ "a.lua", " 3 " },
+		{ "a.py", " 4 " },
+		{ "dir.lua\\A.PYW", " 4 " },
+	};
+
+	for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	{
+		DS_ScopedArena<4096> arena;
+		DS_Array<DS_StringView> ranges_to_keep(&arena);
+		DS_Array<PythonBlock> blocks(&arena);
+		GetFileParser(cases[i].Path)(&arena, ALL_SYNTAXES_TEXT, &ranges_to_keep, &blocks);
+		bool ok = blocks.Size == 1 && blocks[0].Source == cases[i].Source && ranges_to_keep.Size == 2;
+		if (!TEST_CHECK(ok))
+			printf("  the syntax of %s\n", cases[i].Path);
+	}
+}
+
+// Parses `text` as C and checks the names of the blocks and the blocks that each of them depends on
+static void CheckBlockDependencies(DS_StringView text, DS_Slice<DS_StringView> expected_names, DS_Slice<DS_Slice<intptr_t>> expected_dependencies)
+{
+	DS_ScopedArena<4096> arena;
+	DS_Array<DS_StringView> ranges_to_keep(&arena);
+	DS_Array<PythonBlock> blocks(&arena);
+	GetFileParser("named_blocks.cpp")(&arena, text, &ranges_to_keep, &blocks);
+
+	bool ok = blocks.Size == expected_names.Size;
+	for (intptr_t i = 0; i < blocks.Size && ok; i++)
+	{
+		ok = blocks[i].Name == expected_names[i] && blocks[i].Dependencies.Size == expected_dependencies[i].Size;
+		for (intptr_t j = 0; j < blocks[i].Dependencies.Size && ok; j++)
+			ok = blocks[i].Dependencies[j] == expected_dependencies[i][j];
+	}
+	if (!TEST_CHECK(ok))
+		printf("  the dependencies in \"%.*s\"\n", (int)text.Size, text.Data);
+}
+
+static void TestBlockDependencies()
+{
+	static intptr_t on_0[] = { 0 };
+	static intptr_t on_1[] = { 1 };
+	static intptr_t on_1_0[] = { 1, 0 };
+
+	// A chain: only the direct dependency is listed, since the evaluation order follows the chain anyway
+	{
+		DS_StringView names[] = { "a", "b", "" };
+		DS_Slice<intptr_t> dependencies[] = { {}, on_0, on_1 };
+		CheckBlockDependencies("/*.py:a 2 */ /**/ /*.py:b a * 3 */ /**/ /*.py b + 1 */ /**/", names, dependencies);
+	}
+
+	// Identifiers that only contain a name aren't uses of it
+	{
+		DS_StringView names[] = { "ab", "" };
+		DS_Slice<intptr_t> dependencies[] = { {}, {} };
+		CheckBlockDependencies("/*.py:ab 1 */ /**/ /*.py abc + xab + a_b + ab2 + _ab */ /**/", names, dependencies);
+	}
+
+	// A name in a string or a comment counts as a use, in the order the names are first used
+	{
+		DS_StringView names[] = { "a", "b", "" };
+		DS_Slice<intptr_t> dependencies[] = { {}, {}, on_1_0 };
+		CheckBlockDependencies("/*.py:a 1 */ /**/ /*.py:b 2 */ /**/ /*.py\n\t# b\n\treturn 'a' + 'b'\n*/ /**/", names, dependencies);
+	}
+
+	// The closest earlier block of the same name is used, and a block can't use itself or later blocks
+	{
+		DS_StringView names[] = { "a", "a", "", "c", "c" };
+		DS_Slice<intptr_t> dependencies[] = { {}, on_0, on_1, {}, {} };
+		CheckBlockDependencies("/*.py:a 1 */ /**/ /*.py:a a */ /**/ /*.py a */ /**/ /*.py:c c */ /**/ /*.py:c 1 */ /**/", names, dependencies);
+	}
+
+	// Names can't start with a digit, so this is an unnamed block with the code ":1a 1"
+	{
+		DS_StringView names[] = { "" };
+		DS_Slice<intptr_t> dependencies[] = { {} };
+		CheckBlockDependencies("/*.py:1a 1 */ /**/", names, dependencies);
+	}
+}
+
+void TestBlockParser()
+{
+	TestRandom random = { 6 };
+	TestFindMarker(&random);
+	TestGetFileParser();
+	TestBlockDependencies();
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+
+// Tests DS_ConcurrentMap with readers that run while writers add entries, and measures how lookups scale with the number of
+// reader threads, compared to a DS_Map behind a mutex, which is how the evaluator's result cache used to be shared.
+
+// Two halves that must always match, so that a reader would notice a value that was published before it was completely written
+struct ConcurrentMapValue
+{
+	uint64_t Key;
+	uint64_t Check;
+};
+
+static ConcurrentMapValue MakeConcurrentMapValue(uint64_t key)
+{
+	return ConcurrentMapValue{ key, ~key };
+}
+
+static uint64_t ConcurrentMapKey(intptr_t i)
+{
+	// Keys must be well distributed and non-zero
+	TestRandom random = { (uint64_t)i };
+	return random.Next() | 1;
+}
+
+#define CONCURRENT_MAP_MAX_THREADS 64
+
+void TestConcurrentMap()
+{
+	// Single-threaded: adding a key twice keeps the first value
+	{
+		DS_ConcurrentMap<uint64_t, ConcurrentMapValue> map;
+		map.Init();
+		ConcurrentMapValue value;
+		TEST_CHECK(!map.Find(5, &value));
+		TEST_CHECK(map.Add(5, MakeConcurrentMapValue(5)));
+		TEST_CHECK(!map.Add(5, MakeConcurrentMapValue(6)));
+		TEST_CHECK(map.Find(5, &value) && value.Key == 5);
+		TEST_CHECK(map.Count() == 1);
+		map.Deinit();
+	}
+
+	// Writers add disjoint ranges of keys while readers look up all keys. A key that is found must have its complete value, and
+	// a key that has been found must never disappear again, even while its shard grows into a new table.
+	const int num_writers = 4;
+	const int num_readers = 4;
+	const intptr_t keys_per_writer = 100000;
+	const intptr_t num_keys = keys_per_writer * num_writers;
+
+	DS_ConcurrentMap<uint64_t, ConcurrentMapValue> map;
+	map.Init();
+	std::atomic<int> writers_done = 0;
+	std::atomic<intptr_t> torn_values = 0;
+	std::atomic<intptr_t> lost_keys = 0;
+
+	std::thread threads[num_writers + num_readers];
+	for (int w = 0; w < num_writers; w++)
+	{
+		threads[w] = std::thread([&, w]() {
+			for (intptr_t i = w * keys_per_writer; i < (w + 1) * keys_per_writer; i++)
+			{
+				uint64_t key = ConcurrentMapKey(i);
+				map.Add(key, MakeConcurrentMapValue(key));
+			}
+			writers_done += 1;
+		});
+	}
+
+	for (int r = 0; r < num_readers; r++)
+	{
+		threads[num_writers + r] = std::thread([&]() {
+			DS_Array<bool> found;
+			found.Init();
+			found.Resize(num_keys, false);
+			for (bool last_pass = false; !last_pass;)
+			{
+				last_pass = writers_done.load() == num_writers;
+				for (intptr_t i = 0; i < num_keys; i++)
+				{
+					uint64_t key = ConcurrentMapKey(i);
+					ConcurrentMapValue value;
+					if (map.Find(key, &value))
+					{
+						torn_values += value.Key != key || value.Check != ~key;
+						found[i] = true;
+					}
+					else
+						lost_keys += found[i] || last_pass;
+				}
+			}
+			found.Deinit();
+		});
+	}
+
+	for (int i = 0; i < num_writers + num_readers; i++)
+		threads[i].join();
+
+	TEST_CHECK(torn_values == 0);
+	TEST_CHECK(lost_keys == 0);
+	TEST_CHECK(map.Count() == num_keys);
+	map.Deinit();
+}
+
+// Returns the total number of lookups per second when `num_threads` threads look up random keys at the same time
+template<typename FIND_FN>
+static double MeasureLookups(int num_threads, intptr_t num_keys, intptr_t lookups_per_thread, FIND_FN find)
+{
+	std::atomic<intptr_t> num_found = 0;
+	std::thread threads[CONCURRENT_MAP_MAX_THREADS];
+	uint64_t start_time = OS_GetTimeMicroseconds();
+	for (int t = 0; t < num_threads; t++)
+	{
+		threads[t] = std::thread([&, t]() {
+			TestRandom random = { (uint64_t)t + 1000 };
+			intptr_t found = 0;
+			for (intptr_t i = 0; i < lookups_per_thread; i++)
+				found += find(ConcurrentMapKey((intptr_t)(random.Next() % (uint64_t)num_keys)));
+			num_found += found;
+		});
+	}
+	for (int t = 0; t < num_threads; t++)
+		threads[t].join();
+	double seconds = (OS_GetTimeMicroseconds() - start_time) / 1000000.0;
+
+	TEST_CHECK(num_found == lookups_per_thread * num_threads);
+	return lookups_per_thread * num_threads / seconds;
+}
+
+void BenchConcurrentMap()
+{
+	const intptr_t num_keys = 1 << 16;
+	const intptr_t lookups_per_thread = 500000;
+
+	DS_ConcurrentMap<uint64_t, ConcurrentMapValue> concurrent_map;
+	concurrent_map.Init();
+	DS_Map<uint64_t, ConcurrentMapValue> locked_map;
+	locked_map.Init();
+	OS_Mutex mutex = {};
+	for (intptr_t i = 0; i < num_keys; i++)
+	{
+		uint64_t key = ConcurrentMapKey(i);
+		concurrent_map.Add(key, MakeConcurrentMapValue(key));
+		locked_map.Set(key, MakeConcurrentMapValue(key));
+	}
+
+	printf("%-30s %16s %16s\n", "64K keys, reader threads", "DS_Map+mutex", "DS_ConcurrentMap");
+	printf("%-30s %16s %16s\n", "", "(M lookups/s)", "(M lookups/s)");
+	for (int num_threads = 1; num_threads <= CONCURRENT_MAP_MAX_THREADS; num_threads *= 2)
+	{
+		double locked = MeasureLookups(num_threads, num_keys, lookups_per_thread, [&](uint64_t key) {
+			OS_MutexLock(&mutex);
+			ConcurrentMapValue value;
+			bool found = locked_map.Find(key, &value);
+			OS_MutexUnlock(&mutex);
+			return found && value.Key == key;
+		});
+		double concurrent = MeasureLookups(num_threads, num_keys, lookups_per_thread, [&](uint64_t key) {
+			ConcurrentMapValue value;
+			return concurrent_map.Find(key, &value) && value.Key == key;
+		});
+
+		char label[64];
+		snprintf(label, sizeof(label), "%d", num_threads);
+		printf("%-30s %16.1f %16.1f\n", label, locked / 1000000.0, concurrent / 1000000.0);
+	}
+
+	concurrent_map.Deinit();
+	locked_map.Deinit();
+}
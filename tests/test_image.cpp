@@ -0,0 +1,202 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "tests.h"
+
+// Writes arrays and maps into a DS_ImageWriter and reads them back with DS_Image, then checks that DS_Image rejects images that are
+// truncated, from another version, corrupted, or that would point outside of themselves.
+
+struct ImageTestItem
+{
+	uint32_t A;
+	uint16_t B;
+};
+
+enum ImageTestSection
+{
+	ImageTestSection_Bytes,
+	ImageTestSection_Words,
+	ImageTestSection_Items,
+	ImageTestSection_Empty,
+	ImageTestSection_ThreeSlots,
+	ImageTestSection_Map,
+	ImageTestSection_EmptyMap,
+	ImageTestSection_COUNT,
+};
+
+// Copies the image into memory that is aligned like a memory-mapped file, and calls `modify` on the copy before opening it. If
+// `fix_checksum` is set, the checksum is updated after the modification, so that the checks after the checksum can be tested.
+template<typename MODIFY_FN>
+static bool OpenModifiedImage(DS_Arena* arena, DS_StringView image, bool verify_checksum, bool fix_checksum, DS_Image* out_image, MODIFY_FN modify)
+{
+	char* copy = arena->PushUninitialized(image.Size > 0 ? image.Size : 1, DS_IMAGE_ALIGNMENT);
+	memcpy(copy, image.Data, image.Size);
+	DS_StringView data(copy, image.Size);
+	modify(copy, &data);
+
+	if (fix_checksum && data.Size >= (intptr_t)sizeof(DS_ImageHeader))
+		((DS_ImageHeader*)copy)->Checksum = DS_Hash64(copy + sizeof(DS_ImageHeader), data.Size - sizeof(DS_ImageHeader));
+	return out_image->Open(data, verify_checksum);
+}
+
+static DS_ImageSection* GetImageSection(char* image, int section)
+{
+	return (DS_ImageSection*)(image + sizeof(DS_ImageHeader)) + section;
+}
+
+void TestImage()
+{
+	TestRandom random = { 8 };
+
+	// Element counts and sizes that leave the end of a section unaligned
+	DS_Array<uint8_t> bytes;
+	DS_Array<uint64_t> words;
+	DS_Array<ImageTestItem> items;
+	DS_Map<uint64_t, uint32_t> map, empty_map;
+	bytes.Init();
+	words.Init();
+	items.Init();
+	map.Init();
+	empty_map.Init();
+	for (int i = 0; i < 13; i++)
+		bytes.Add((uint8_t)random.Next());
+	for (int i = 0; i < 1000; i++)
+		words.Add(random.Next());
+	for (int i = 0; i < 7; i++)
+		items.Add(ImageTestItem{ (uint32_t)random.Next(), (uint16_t)i });
+	for (uint32_t i = 0; i < 1000; i++)
+		map.Set(words[i] | 1, i);
+
+	DS_ImageWriter writer;
+	writer.Init();
+	TEST_CHECK(writer.AddArray(DS_Slice<uint8_t>(bytes)) == ImageTestSection_Bytes);
+	TEST_CHECK(writer.AddArray(DS_Slice<uint64_t>(words)) == ImageTestSection_Words);
+	TEST_CHECK(writer.AddArray(DS_Slice<ImageTestItem>(items)) == ImageTestSection_Items);
+	TEST_CHECK(writer.AddArray(DS_Slice<uint64_t>()) == ImageTestSection_Empty);
+	TEST_CHECK(writer.AddArray(DS_Slice<DS_MapSlot<uint64_t, uint32_t>>(map.Data, 3)) == ImageTestSection_ThreeSlots);
+	TEST_CHECK(writer.AddMap(map) == ImageTestSection_Map);
+	TEST_CHECK(writer.AddMap(empty_map) == ImageTestSection_EmptyMap);
+
+	DS_DynamicString image_string;
+	image_string.Init();
+	writer.Finish(&image_string);
+	writer.Deinit();
+	DS_StringView image = image_string;
+
+	DS_ScopedArena<1024> arena;
+	auto unmodified = [](char* data, DS_StringView* view) {};
+
+	// Round trip
+	{
+		DS_Image loaded;
+		TEST_CHECK(OpenModifiedImage(&arena, image, true, false, &loaded, unmodified));
+
+		DS_Slice<uint8_t> loaded_bytes;
+		DS_Slice<uint64_t> loaded_words, loaded_empty;
+		DS_Slice<ImageTestItem> loaded_items;
+		TEST_CHECK(loaded.GetArray(ImageTestSection_Bytes, &loaded_bytes) && loaded_bytes.Size == bytes.Size &&
+			memcmp(loaded_bytes.Data, bytes.Data, bytes.Size) == 0);
+		TEST_CHECK(loaded.GetArray(ImageTestSection_Words, &loaded_words) && loaded_words.Size == words.Size &&
+			memcmp(loaded_words.Data, words.Data, words.Size * sizeof(uint64_t)) == 0);
+		TEST_CHECK(((uintptr_t)loaded_words.Data & (alignof(uint64_t) - 1)) == 0);
+		TEST_CHECK(loaded.GetArray(ImageTestSection_Items, &loaded_items) && loaded_items.Size == items.Size &&
+			loaded_items[6].A == items[6].A && loaded_items[6].B == 6);
+		TEST_CHECK(loaded.GetArray(ImageTestSection_Empty, &loaded_empty) && loaded_empty.Size == 0);
+
+		DS_Map<uint64_t, uint32_t> loaded_map;
+		TEST_CHECK(loaded.GetMap(ImageTestSection_Map, &loaded_map) && loaded_map.NumElems == map.NumElems);
+		bool all_found = true;
+		for (uint32_t i = 0; i < 1000; i++)
+		{
+			uint32_t value;
+			all_found = all_found && loaded_map.Find(words[i] | 1, &value) && value == i;
+		}
+		TEST_CHECK(all_found);
+		TEST_CHECK(!loaded_map.Has(2)); // Even keys were never added
+
+		DS_Map<uint64_t, uint32_t> loaded_empty_map;
+		TEST_CHECK(loaded.GetMap(ImageTestSection_EmptyMap, &loaded_empty_map) && loaded_empty_map.NumElems == 0 && !loaded_empty_map.Has(1));
+
+		// Sections that don't exist, or that are read as the wrong type
+		DS_Slice<uint32_t> wrong_size;
+		DS_Map<uint32_t, uint32_t> wrong_map;
+		TEST_CHECK(!loaded.GetArray(-1, &loaded_words));
+		TEST_CHECK(!loaded.GetArray(ImageTestSection_COUNT, &loaded_words));
+		TEST_CHECK(!loaded.GetArray(ImageTestSection_Words, &wrong_size));
+		TEST_CHECK(!loaded.GetMap(ImageTestSection_Map, &wrong_map));
+
+		// Map slots whose count isn't a power of two, written with AddArray
+		TEST_CHECK(!loaded.GetMap(ImageTestSection_ThreeSlots, &loaded_map));
+	}
+
+	// Truncated images, including ones that are cut off in the header and in the section table
+	static const intptr_t truncated_sizes[] = { 0, 1, (intptr_t)sizeof(DS_ImageHeader) - 1, (intptr_t)sizeof(DS_ImageHeader), (intptr_t)sizeof(DS_ImageHeader) + 8, image.Size - 1 };
+	for (int i = 0; i < (int)(sizeof(truncated_sizes) / sizeof(truncated_sizes[0])); i++)
+	{
+		DS_Image loaded;
+		intptr_t size = truncated_sizes[i];
+		if (!TEST_CHECK(!OpenModifiedImage(&arena, image, false, false, &loaded, [&](char* data, DS_StringView* view) { view->Size = size; })))
+			printf("  image truncated to %lld bytes\n", (long long)size);
+	}
+
+	// Each of these must be rejected, with and without checksum verification
+	struct ImageCorruption
+	{
+		const char* Name;
+		void (*Modify)(char* data, DS_StringView* view);
+	};
+	static const ImageCorruption corruptions[] = {
+		{ "bad magic", [](char* data, DS_StringView* view) { ((DS_ImageHeader*)data)->Magic ^= 1; } },
+		{ "bad version", [](char* data, DS_StringView* view) { ((DS_ImageHeader*)data)->Version += 1; } },
+		{ "too many sections", [](char* data, DS_StringView* view) { ((DS_ImageHeader*)data)->NumSections = (uint32_t)(view->Size / sizeof(DS_ImageSection)); } },
+		{ "section offset past the end", [](char* data, DS_StringView* view) { GetImageSection(data, ImageTestSection_Words)->Offset = (uint64_t)view->Size + DS_IMAGE_ALIGNMENT; } },
+		{ "unaligned section offset", [](char* data, DS_StringView* view) { GetImageSection(data, ImageTestSection_Words)->Offset += 8; } },
+		{ "section count past the end", [](char* data, DS_StringView* view) { GetImageSection(data, ImageTestSection_Map)->Count += 1; } }, // The last section with contents
+		{ "huge section count", [](char* data, DS_StringView* view) { GetImageSection(data, ImageTestSection_Bytes)->Count = UINT64_MAX; } },
+		{ "zero item size", [](char* data, DS_StringView* view) { GetImageSection(data, ImageTestSection_Bytes)->ItemSize = 0; } },
+	};
+	for (int i = 0; i < (int)(sizeof(corruptions) / sizeof(corruptions[0])); i++)
+	{
+		for (int verify = 0; verify < 2; verify++)
+		{
+			DS_Image loaded;
+			if (!TEST_CHECK(!OpenModifiedImage(&arena, image, verify == 1, true, &loaded, corruptions[i].Modify)))
+				printf("  %s%s\n", corruptions[i].Name, verify ? ", with checksum verification" : "");
+		}
+	}
+
+	// A map section that claims to have as many elements as slots, which would make lookups of missing keys loop forever
+	{
+		DS_Image loaded;
+		DS_Map<uint64_t, uint32_t> loaded_map;
+		auto full_map = [](char* data, DS_StringView* view) {
+			DS_ImageSection* section = GetImageSection(data, ImageTestSection_Map);
+			section->NumElems = (int32_t)section->Count;
+		};
+		TEST_CHECK(OpenModifiedImage(&arena, image, true, true, &loaded, full_map) && !loaded.GetMap(ImageTestSection_Map, &loaded_map));
+	}
+
+	// A flipped bit in the contents is only noticed when the checksum is verified
+	{
+		DS_Image loaded;
+		auto flip_bit = [](char* data, DS_StringView* view) { data[view->Size - 1] ^= 1; };
+		TEST_CHECK(!OpenModifiedImage(&arena, image, true, false, &loaded, flip_bit));
+		TEST_CHECK(OpenModifiedImage(&arena, image, false, false, &loaded, flip_bit));
+	}
+
+	// Data that isn't aligned like a memory-mapped file
+	{
+		DS_Image loaded;
+		char* unaligned = arena.PushUninitialized(image.Size + 8, DS_IMAGE_ALIGNMENT) + 8;
+		memcpy(unaligned, image.Data, image.Size);
+		TEST_CHECK(!loaded.Open(DS_StringView(unaligned, image.Size)));
+	}
+
+	image_string.Deinit();
+	bytes.Deinit();
+	words.Deinit();
+	items.Deinit();
+	map.Deinit();
+	empty_map.Deinit();
+}
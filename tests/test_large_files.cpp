@@ -0,0 +1,82 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+#include <Windows.h>
+
+// Expands a file that is larger than 4 GB with PyExpand.exe. The file is mostly a sparse
+// hole of zeros between a block at the start and a block past the 4 GB mark, so it takes little disk space until PyExpand rewrites it.
+// PyExpand holds the file and its expansion in memory, so this needs about 9 GB of memory and disk space, and only runs when named.
+
+#define LARGE_FILE_HOLE_SIZE (4ull * 1024 * 1024 * 1024 + 12345)
+
+static const char LARGE_FILE_PATH[] = "pyexpand_large_file_test.cpp";
+static const DS_StringView LARGE_FILE_HEAD = "int a = /*.py 1+1 */ /**/;\n";
+static const DS_StringView LARGE_FILE_TAIL = "\nint b = /*.py 2+2 */ /**/;\n";
+static const DS_StringView EXPANDED_HEAD = "int a = /*.py 1+1 */ 2 /**/;\n";
+static const DS_StringView EXPANDED_TAIL = "\nint b = /*.py 2+2 */ 4 /**/;\n";
+
+static bool WriteAt(HANDLE file, uint64_t offset, DS_StringView data)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)offset;
+	DWORD written = 0;
+	return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && WriteFile(file, data.Data, (DWORD)data.Size, &written, NULL) && written == (DWORD)data.Size;
+}
+
+static bool CreateSparseFile()
+{
+	HANDLE file = CreateFileA(LARGE_FILE_PATH, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// If the file system doesn't support sparse files, the hole is written out as zeros, which is slower but still works
+	DWORD returned;
+	DeviceIoControl(file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+
+	bool ok = WriteAt(file, 0, LARGE_FILE_HEAD) && WriteAt(file, LARGE_FILE_HEAD.Size + LARGE_FILE_HOLE_SIZE, LARGE_FILE_TAIL);
+	CloseHandle(file);
+	return ok;
+}
+
+static bool ReadAt(FILE* f, uint64_t offset, DS_Arena* arena, intptr_t size, DS_StringView* out_data)
+{
+	char* data = arena->PushUninitialized(size);
+	*out_data = DS_StringView(data, size);
+	return _fseeki64(f, (long long)offset, SEEK_SET) == 0 && fread(data, 1, (size_t)size, f) == (size_t)size;
+}
+
+void TestLargeFiles()
+{
+	DS_ScopedArena<1024> temp;
+
+	if (!TEST_CHECK(CreateSparseFile()))
+		return;
+
+	TEST_CHECK(RunPyExpand(LARGE_FILE_PATH));
+
+	// Both results must be spliced in, and everything in between must have moved by the size of the first result
+	uint64_t expanded_size = EXPANDED_HEAD.Size + LARGE_FILE_HOLE_SIZE + EXPANDED_TAIL.Size;
+	FILE* f = fopen(LARGE_FILE_PATH, "rb");
+	if (TEST_CHECK(f != NULL))
+	{
+		_fseeki64(f, 0, SEEK_END);
+		TEST_CHECK((uint64_t)_ftelli64(f) == expanded_size);
+
+		DS_StringView head, hole_end, tail;
+		TEST_CHECK(ReadAt(f, 0, &temp, EXPANDED_HEAD.Size, &head) && head == EXPANDED_HEAD);
+		TEST_CHECK(ReadAt(f, expanded_size - EXPANDED_TAIL.Size, &temp, EXPANDED_TAIL.Size, &tail) && tail == EXPANDED_TAIL);
+
+		// The last bytes of the hole must still be zeros, i.e. nothing was lost or duplicated around the 4 GB mark
+		bool hole_ok = ReadAt(f, expanded_size - EXPANDED_TAIL.Size - 16, &temp, 16, &hole_end);
+		for (intptr_t i = 0; i < hole_end.Size; i++)
+			hole_ok = hole_ok && hole_end.Data[i] == 0;
+		TEST_CHECK(hole_ok);
+		fclose(f);
+	}
+
+	OS_DeleteFile(LARGE_FILE_PATH);
+}
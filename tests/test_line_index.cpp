@@ -0,0 +1,259 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/line_index.h"
+#include "tests.h"
+
+// Compares the SSE2 line utilities with simple byte-by-byte versions on random text. The sizes cover every remainder of the 16-byte
+// chunks, and the sizes around 255 chunks, after which CountLineEndings sums up its 8-bit counters. Its chunks start at byte 1, so the
+// counters only overflow in text of more than 256 * 16 bytes.
+
+static const intptr_t LINE_TEXT_SIZES[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 255 * 16 - 1, 255 * 16, 255 * 16 + 1, 256 * 16, 256 * 16 + 1 };
+
+#define LINE_TEXT_SIZE_COUNT (int)(sizeof(LINE_TEXT_SIZES) / sizeof(LINE_TEXT_SIZES[0]))
+
+// Random text made of the characters that matter to the line utilities, so that it has many "\r\n", lone "\r" and indented lines
+static void MakeLineText(DS_Array<char>* out, intptr_t size, TestRandom* random)
+{
+	static const char chars[] = "ab \t\r\n\r\n\n";
+	out->Clear();
+	for (intptr_t i = 0; i < size; i++)
+		out->Add(chars[random->Next() % (sizeof(chars) - 1)]);
+}
+
+static DS_StringView LineTextView(const DS_Array<char>& text)
+{
+	return DS_StringView(text.Data, text.Size);
+}
+
+static void ReferenceLineStarts(DS_StringView text, DS_Array<intptr_t>* out)
+{
+	out->Clear();
+	out->Add(0);
+	for (intptr_t i = 0; i < text.Size; i++)
+	{
+		if (text.Data[i] == '\n')
+			out->Add(i + 1);
+	}
+}
+
+static bool LineStartsMatch(const LineIndex& index, const DS_Array<intptr_t>& expected, intptr_t text_size)
+{
+	return index.TextSize == text_size && index.LineStarts.Size == expected.Size &&
+		memcmp(index.LineStarts.Data, expected.Data, expected.Size * sizeof(intptr_t)) == 0;
+}
+
+// Applies a few edits of every combination of text size and inserted size to the same index, and compares the index with one that
+// is built from scratch from the edited text.
+static void TestUpdateLineIndex(TestRandom* random)
+{
+	DS_Array<char> text, inserted, edited;
+	DS_Array<intptr_t> expected;
+	text.Init();
+	inserted.Init();
+	edited.Init();
+	expected.Init();
+
+	for (int s = 0; s < LINE_TEXT_SIZE_COUNT; s++)
+	{
+		for (int n = 0; n < LINE_TEXT_SIZE_COUNT; n++)
+		{
+			DS_ScopedArena<1024> arena;
+			LineIndex index;
+			MakeLineText(&text, LINE_TEXT_SIZES[s], random);
+			BuildLineIndex(&arena, LineTextView(text), &index);
+			ReferenceLineStarts(LineTextView(text), &expected);
+			if (!TEST_CHECK(LineStartsMatch(index, expected, text.Size)))
+				printf("  BuildLineIndex on %lld bytes\n", (long long)text.Size);
+
+			for (int edit = 0; edit < 4; edit++)
+			{
+				// Removing nothing, the whole text, or a random range that may split a "\r\n"
+				intptr_t offset = (intptr_t)(random->Next() % (uint64_t)(text.Size + 1));
+				intptr_t removed_size = (intptr_t)(random->Next() % (uint64_t)(text.Size - offset + 1));
+				if (edit == 1) removed_size = 0;
+				if (edit == 2) offset = 0, removed_size = text.Size;
+				MakeLineText(&inserted, LINE_TEXT_SIZES[n], random);
+
+				edited.Clear();
+				edited.AddSlice(DS_Slice<char>(text.Data, offset));
+				edited.AddSlice(inserted);
+				edited.AddSlice(DS_Slice<char>(text.Data + offset + removed_size, text.Size - offset - removed_size));
+
+				UpdateLineIndex(&index, offset, removed_size, LineTextView(inserted));
+				ReferenceLineStarts(LineTextView(edited), &expected);
+				if (!TEST_CHECK(LineStartsMatch(index, expected, edited.Size)))
+				{
+					printf("  UpdateLineIndex on %lld bytes, replacing %lld bytes at %lld with %lld bytes\n", (long long)text.Size,
+						(long long)removed_size, (long long)offset, (long long)inserted.Size);
+					break;
+				}
+
+				text.Clear();
+				text.AddSlice(edited);
+			}
+		}
+	}
+
+	text.Deinit();
+	inserted.Deinit();
+	edited.Deinit();
+	expected.Deinit();
+}
+
+static void ReferenceReindentLines(DS_StringView text, DS_StringView indent, DS_StringView line_ending, int flags, DS_Array<char>* out)
+{
+	for (intptr_t start = 0; start < text.Size;)
+	{
+		intptr_t end = text.FindChar('\n', start);
+		bool has_newline = end < text.Size;
+		intptr_t next_start = has_newline ? end + 1 : end;
+		if (has_newline && end > start && text.Data[end - 1] == '\r')
+			end -= 1;
+
+		DS_StringView line = text.Slice(start, end);
+		start = next_start;
+		if (line.Size == 0 && (flags & ReindentFlags_SkipEmptyLines))
+			continue;
+
+		if (!(flags & ReindentFlags_OnlyUnindentedLines) || line.Size == 0 || (line.Data[0] != ' ' && line.Data[0] != '\t'))
+			out->AddSlice(indent);
+		out->AddSlice(line);
+		if (has_newline || (flags & ReindentFlags_TerminateLastLine))
+			out->AddSlice(line_ending);
+	}
+}
+
+// Returns false and prints the case if ReindentLines doesn't match the reference. The output is appended to some existing text.
+static bool CheckReindentLines(DS_StringView text, DS_StringView indent, DS_StringView line_ending, int flags, DS_Array<char>* expected)
+{
+	DS_DynamicString out;
+	out.Init();
+	out.Add("prefix");
+	ReindentLines(text, indent, line_ending, flags, &out);
+
+	expected->Clear();
+	expected->AddSlice(DS_StringView("prefix"));
+	ReferenceReindentLines(text, indent, line_ending, flags, expected);
+
+	bool ok = out.Size == expected->Size && memcmp(out.Data, expected->Data, expected->Size) == 0 && out.Data[out.Size] == 0;
+	if (!TEST_CHECK(ok))
+		printf("  ReindentLines on %lld bytes with flags %d, indent \"%.*s\"\n", (long long)text.Size, flags, (int)indent.Size, indent.Data);
+	out.Deinit();
+	return ok;
+}
+
+// Every combination of flags, on random text of every size and on the edge cases of "\r" handling
+static void TestReindentLines(TestRandom* random)
+{
+	static const DS_StringView indents[] = { "", "\t", "    " };
+	static const DS_StringView line_endings[] = { "\n", "\r\n", "\n", };
+	static const DS_StringView edge_cases[] = { "", "\n", "\r", "a\r", "\r\r\n", "\n\r", "a\rb", "\r\n\r\n", " a\n\tb\n\nc" };
+	const int all_flags = ReindentFlags_SkipEmptyLines | ReindentFlags_OnlyUnindentedLines | ReindentFlags_TerminateLastLine;
+
+	DS_Array<char> text, expected;
+	text.Init();
+	expected.Init();
+
+	for (int flags = 0; flags <= all_flags; flags++)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			bool ok = true;
+			for (int s = 0; s < LINE_TEXT_SIZE_COUNT && ok; s++)
+			{
+				MakeLineText(&text, LINE_TEXT_SIZES[s], random);
+				ok = CheckReindentLines(LineTextView(text), indents[i], line_endings[i], flags, &expected);
+			}
+			for (int e = 0; e < (int)(sizeof(edge_cases) / sizeof(edge_cases[0])) && ok; e++)
+				ok = CheckReindentLines(edge_cases[e], indents[i], line_endings[i], flags, &expected);
+		}
+
+		// Empty text has no lines, so there's no last line to terminate
+		DS_DynamicString out;
+		out.Init();
+		ReindentLines("", "\t", "\n", flags, &out);
+		TEST_CHECK(out.Size == 0);
+		out.Deinit();
+	}
+
+	text.Deinit();
+	expected.Deinit();
+}
+
+static LineEndingCounts ReferenceCountLineEndings(DS_StringView text)
+{
+	LineEndingCounts counts = {};
+	for (intptr_t i = 0; i < text.Size; i++)
+	{
+		if (text.Data[i] == '\n')
+		{
+			counts.Newlines += 1;
+			counts.CRLFs += i > 0 && text.Data[i - 1] == '\r';
+		}
+	}
+	return counts;
+}
+
+static bool CheckCountLineEndings(const DS_Array<char>& text, const char* description)
+{
+	LineEndingCounts counts = CountLineEndings(LineTextView(text));
+	LineEndingCounts expected = ReferenceCountLineEndings(LineTextView(text));
+	bool ok = counts.Newlines == expected.Newlines && counts.CRLFs == expected.CRLFs;
+	if (!TEST_CHECK(ok))
+		printf("  CountLineEndings on %lld bytes of %s\n", (long long)text.Size, description);
+	return ok;
+}
+
+static void TestCountLineEndings(TestRandom* random)
+{
+	DS_Array<char> text;
+	text.Init();
+
+	for (int s = 0; s < LINE_TEXT_SIZE_COUNT; s++)
+	{
+		intptr_t size = LINE_TEXT_SIZES[s];
+		MakeLineText(&text, size, random);
+		CheckCountLineEndings(text, "random text");
+
+		// Only newlines, or only "\r\n", so that every 8-bit counter reaches its maximum before the counters are summed up
+		text.Clear();
+		text.Resize(size, '\n');
+		CheckCountLineEndings(text, "newlines");
+		for (intptr_t i = 0; i < size; i++)
+			text[i] = i % 2 ? '\n' : '\r';
+		CheckCountLineEndings(text, "\"\\r\\n\"");
+
+		// A single "\r\n" at every position of short text, and at the 16-byte boundaries of long text, where the "\r" is in one
+		// chunk and the "\n" in the next. A lone "\r" is at the end.
+		for (intptr_t at = 0; at + 1 < size; at++)
+		{
+			if (size > 64 && at % 16 > 1 && at % 16 < 15 && at + 2 < size)
+				continue;
+			text.Clear();
+			text.Resize(size, 'a');
+			text[at] = '\r';
+			text[at + 1] = '\n';
+			text[size - 1] = text[size - 1] == 'a' ? '\r' : text[size - 1];
+			if (!CheckCountLineEndings(text, "text with one \"\\r\\n\""))
+				break;
+		}
+	}
+
+	// DetectLineEnding prefers "\n" on a tie
+	TEST_CHECK(DetectLineEnding("") == "\n");
+	TEST_CHECK(DetectLineEnding("a\r\nb\n") == "\n");
+	TEST_CHECK(DetectLineEnding("a\r\nb\r\nc\n") == "\r\n");
+	TEST_CHECK(DetectLineEnding("a\rb\rc\n") == "\n");
+
+	text.Deinit();
+}
+
+void TestLineIndex()
+{
+	TestRandom random = { 5 };
+	TestUpdateLineIndex(&random);
+	TestReindentLines(&random);
+	TestCountLineEndings(&random);
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+
+// Checks DS_Map::FindMany against FindPtr, and measures how much its prefetching helps on a map that is much larger than the L3
+// cache, where every lookup of FindPtr is a cache miss, compared to a map that fits in the L2 cache.
+
+// Fills the map with `num_elems` random keys, mapped to their index, and returns `num_lookups` keys to look up. One in eight of
+// them isn't in the map.
+static void MakeMapAndLookups(DS_Map<uint64_t, uint64_t>* map, DS_Array<uint64_t>* lookups, intptr_t num_elems, intptr_t num_lookups, TestRandom* random)
+{
+	DS_Array<uint64_t> keys;
+	keys.Init(NULL, num_elems);
+	for (intptr_t i = 0; i < num_elems; i++)
+	{
+		uint64_t key = random->Next() | 1; // Zero is reserved for empty slots
+		keys.Add(key);
+		map->Set(key, (uint64_t)i);
+	}
+
+	lookups->Clear();
+	for (intptr_t i = 0; i < num_lookups; i++)
+	{
+		uint64_t r = random->Next();
+		lookups->Add(r % 8 == 0 || num_elems == 0 ? r & ~1ull : keys[(intptr_t)(r >> 8) % num_elems]); // Even keys are never in the map
+	}
+	keys.Deinit();
+}
+
+void TestMap()
+{
+	TestRandom random = { 3 };
+	DS_Array<uint64_t> lookups;
+	DS_Array<uint64_t*> values;
+	lookups.Init();
+	values.Init();
+
+	// Fewer keys than the prefetch distance, more keys than it and a map that was never added to
+	static const intptr_t sizes[][2] = { {0, 5}, {1, 5}, {10, 10}, {1000, 3}, {1000, 10000}, {100000, 100000} }; // Elements, lookups
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		DS_Map<uint64_t, uint64_t> map;
+		map.Init();
+		MakeMapAndLookups(&map, &lookups, sizes[s][0], sizes[s][1], &random);
+
+		values.Clear();
+		values.Resize(lookups.Size, NULL);
+		map.FindMany(lookups, values.Data);
+
+		bool ok = true;
+		for (intptr_t i = 0; i < lookups.Size; i++)
+			ok = ok && values[i] == map.FindPtr(lookups[i]);
+		if (!TEST_CHECK(ok))
+			printf("  with %lld elements and %lld lookups\n", (long long)sizes[s][0], (long long)sizes[s][1]);
+		map.Deinit();
+	}
+
+	lookups.Deinit();
+	values.Deinit();
+}
+
+void BenchMap()
+{
+	const intptr_t num_lookups = 10000000;
+	TestRandom random = { 4 };
+	DS_Array<uint64_t> lookups;
+	DS_Array<uint64_t*> values;
+	lookups.Init(NULL, num_lookups);
+	values.Init(NULL, num_lookups);
+	values.Resize(num_lookups, NULL);
+
+	printf("%-30s %12s %12s %12s\n", "10M lookups, 1/8 misses", "FindPtr (ms)", "FindMany (ms)", "speedup");
+
+	// 2^11 elements in 2^12 slots of 16 bytes is 64 KB. 2^23 elements in 2^24 slots is 256 MB, far beyond any L3 cache.
+	static const int log2_sizes[] = { 11, 23 };
+	for (int s = 0; s < (int)(sizeof(log2_sizes) / sizeof(log2_sizes[0])); s++)
+	{
+		intptr_t num_elems = (intptr_t)1 << log2_sizes[s];
+		DS_Map<uint64_t, uint64_t> map;
+		map.Init(NULL, (int)num_elems * 2);
+		MakeMapAndLookups(&map, &lookups, num_elems, num_lookups, &random);
+
+		uint64_t start_time = OS_GetTimeMicroseconds();
+		for (intptr_t i = 0; i < num_lookups; i++)
+			values[i] = map.FindPtr(lookups[i]);
+		double find_ptr_ms = (OS_GetTimeMicroseconds() - start_time) / 1000.0;
+
+		uint64_t find_ptr_sum = 0;
+		for (intptr_t i = 0; i < num_lookups; i++)
+			find_ptr_sum += values[i] ? *values[i] : 0;
+
+		start_time = OS_GetTimeMicroseconds();
+		map.FindMany(lookups, values.Data);
+		double find_many_ms = (OS_GetTimeMicroseconds() - start_time) / 1000.0;
+
+		uint64_t find_many_sum = 0;
+		for (intptr_t i = 0; i < num_lookups; i++)
+			find_many_sum += values[i] ? *values[i] : 0;
+		TEST_CHECK(find_many_sum == find_ptr_sum);
+
+		char label[64];
+		snprintf(label, sizeof(label), "%d slots (%d MB)", map.NumSlots, (int)(map.NumSlots * sizeof(DS_MapSlot<uint64_t, uint64_t>) >> 20));
+		printf("%-30s %12.1f %12.1f %11.2fx\n", label, find_ptr_ms, find_many_ms, find_ptr_ms / find_many_ms);
+		map.Deinit();
+	}
+
+	lookups.Deinit();
+	values.Deinit();
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+
+// Expands files with named blocks with PyExpand.exe, and checks how values are passed along chains of named blocks, and that the
+// blocks that use a named block that failed, or whose value can't be pickled, get an error message instead of being evaluated.
+
+struct NamedBlocksCase
+{
+	const char* Path;
+	DS_StringView Input;
+	const char* ExpectedParts[4]; // Must appear in the expanded file in this order. NULL after the last one.
+};
+
+static const NamedBlocksCase NAMED_BLOCKS_CASES[] = {
+	{
+		"pyexpand_named_chain_test.cpp",
+		"/*.py:a 2 */ /**/\n/*.py:b a * 3 */ /**/\n/*.py b + 1 */ /**/\n",
+		{ "/*.py:a 2 */ 2 /**/\n/*.py:b a * 3 */ 6 /**/\n/*.py b + 1 */ 7 /**/\n" },
+	},
+	{
+		// The error is passed along the chain: `b` isn't evaluated, so it has no value either
+		"pyexpand_named_failed_test.cpp",
+		"/*.py:a 1 / 0 */ /**/\n/*.py a + 1 */ /**/\n/*.py:b a */ /**/\n/*.py b */ /**/\n",
+		{
+			"ZeroDivisionError",
+			"/*.py a + 1 */ Error: The block named 'a' has no value, since it failed. /**/\n",
+			"/*.py:b a */ Error: The block named 'a' has no value, since it failed. /**/\n",
+			"/*.py b */ Error: The block named 'b' has no value, since it failed. /**/\n",
+		},
+	},
+	{
+		"pyexpand_named_unpicklable_test.cpp",
+		"/*.py:f lambda: 1 */ /**/\n/*.py f() */ /**/\n",
+		{ "PicklingError", "/*.py f() */ Error: The block named 'f' has no value, since it failed. /**/\n" },
+	},
+	{
+		// A name in a string counts as a use, so the block gets the error although it doesn't need the value. A longer identifier
+		// that starts with the name isn't a use.
+		"pyexpand_named_string_test.cpp",
+		"/*.py:n 1 / 0 */ /**/\n/*.py 'n' */ /**/\n/*.py:nn 5 */ /**/\n/*.py nn + 1 */ /**/\n",
+		{
+			"/*.py 'n' */ Error: The block named 'n' has no value, since it failed. /**/\n",
+			"/*.py:nn 5 */ 5 /**/\n/*.py nn + 1 */ 6 /**/\n",
+		},
+	},
+};
+
+#define NAMED_BLOCKS_CASE_COUNT (int)(sizeof(NAMED_BLOCKS_CASES) / sizeof(NAMED_BLOCKS_CASES[0]))
+
+void TestNamedBlocks()
+{
+	DS_ScopedArena<1024> temp;
+
+	// All files are expanded by one run, so that python only starts once
+	DS_DynamicString arguments(&temp);
+	for (int i = 0; i < NAMED_BLOCKS_CASE_COUNT; i++)
+	{
+		TEST_CHECK(OS_WriteFileAtomically(NAMED_BLOCKS_CASES[i].Path, NAMED_BLOCKS_CASES[i].Input));
+		arguments.Addf("%s ", NAMED_BLOCKS_CASES[i].Path);
+	}
+	TEST_CHECK(RunPyExpand(arguments.CStr()));
+
+	for (int i = 0; i < NAMED_BLOCKS_CASE_COUNT; i++)
+	{
+		const NamedBlocksCase& c = NAMED_BLOCKS_CASES[i];
+		DS_StringView output;
+		if (TEST_CHECK(OS_ReadEntireFile(&temp, c.Path, &output)))
+		{
+			intptr_t offset = 0;
+			for (int j = 0; j < 4 && c.ExpectedParts[j]; j++)
+			{
+				intptr_t found = output.Find(DS_Str(c.ExpectedParts[j]), offset);
+				if (!TEST_CHECK(found < output.Size))
+				{
+					printf("  \"%s\" in %s:\n%.*s\n", c.ExpectedParts[j], c.Path, (int)output.Size, output.Data);
+					break;
+				}
+				offset = found + DS_Str(c.ExpectedParts[j]).Size;
+			}
+		}
+		OS_DeleteFile(c.Path);
+	}
+}
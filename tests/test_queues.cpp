@@ -0,0 +1,174 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+
+// Stress tests for DS_SPSCQueue and DS_MPMCQueue. Every producer pushes an increasing sequence of values that are tagged with the
+// producer, and the consumers check that each value arrives exactly once and that the values of each producer arrive in order.
+// The queues are small compared to the number of values, so they wrap around and run full and empty many times.
+
+#define QUEUE_PRODUCER_SHIFT 40
+#define QUEUE_MAX_THREADS 16
+
+struct QueueRunResult
+{
+	double Seconds;
+	uint64_t Sum;         // Sum of the sequence numbers that were popped
+	intptr_t OrderErrors; // Values that arrived before an earlier value of the same producer
+};
+
+static QueueRunResult RunSPSCQueue(intptr_t num_values, size_t capacity)
+{
+	DS_SPSCQueue<uint64_t> queue;
+	queue.Init(capacity);
+
+	QueueRunResult result = {};
+	uint64_t start_time = OS_GetTimeMicroseconds();
+
+	std::thread producer([&]() {
+		for (intptr_t i = 0; i < num_values; i++)
+			while (!queue.Push((uint64_t)i))
+				std::this_thread::yield();
+	});
+
+	uint64_t expected = 0;
+	for (intptr_t i = 0; i < num_values; i++)
+	{
+		uint64_t value;
+		while (!queue.Pop(&value))
+			std::this_thread::yield();
+		result.OrderErrors += value != expected;
+		result.Sum += value;
+		expected = value + 1;
+	}
+
+	producer.join();
+	result.Seconds = (OS_GetTimeMicroseconds() - start_time) / 1000000.0;
+
+	uint64_t leftover;
+	result.OrderErrors += queue.Pop(&leftover);
+	queue.Deinit();
+	return result;
+}
+
+static QueueRunResult RunMPMCQueue(int num_producers, int num_consumers, intptr_t values_per_producer, size_t capacity)
+{
+	DS_ASSERT(num_producers + num_consumers <= QUEUE_MAX_THREADS);
+	DS_MPMCQueue<uint64_t> queue;
+	queue.Init(capacity);
+
+	intptr_t num_values = values_per_producer * num_producers;
+	std::atomic<intptr_t> num_popped = 0;
+	std::atomic<uint64_t> sum = 0;
+	std::atomic<intptr_t> order_errors = 0;
+
+	uint64_t start_time = OS_GetTimeMicroseconds();
+
+	std::thread threads[QUEUE_MAX_THREADS];
+	int num_threads = 0;
+	for (int p = 0; p < num_producers; p++)
+	{
+		threads[num_threads++] = std::thread([&, p]() {
+			for (intptr_t i = 0; i < values_per_producer; i++)
+				while (!queue.Push(((uint64_t)p << QUEUE_PRODUCER_SHIFT) | (uint64_t)i))
+					std::this_thread::yield();
+		});
+	}
+
+	for (int c = 0; c < num_consumers; c++)
+	{
+		threads[num_threads++] = std::thread([&]() {
+			// A single consumer sees the values of each producer in the order they were pushed
+			DS_Array<int64_t> last_seen;
+			last_seen.Init();
+			last_seen.Resize(num_producers, -1);
+			uint64_t local_sum = 0;
+			intptr_t local_order_errors = 0;
+
+			while (num_popped.load(std::memory_order_relaxed) < num_values)
+			{
+				uint64_t value;
+				if (!queue.Pop(&value))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				num_popped.fetch_add(1, std::memory_order_relaxed);
+
+				int producer = (int)(value >> QUEUE_PRODUCER_SHIFT);
+				int64_t sequence = (int64_t)(value & ((1ull << QUEUE_PRODUCER_SHIFT) - 1));
+				if (producer >= num_producers || sequence <= last_seen[producer])
+					local_order_errors += 1;
+				else
+					last_seen[producer] = sequence;
+				local_sum += (uint64_t)sequence;
+			}
+
+			sum += local_sum;
+			order_errors += local_order_errors;
+			last_seen.Deinit();
+		});
+	}
+
+	for (int i = 0; i < num_threads; i++)
+		threads[i].join();
+
+	QueueRunResult result = {};
+	result.Seconds = (OS_GetTimeMicroseconds() - start_time) / 1000000.0;
+	result.Sum = sum;
+	result.OrderErrors = order_errors;
+
+	uint64_t leftover;
+	result.OrderErrors += queue.Pop(&leftover);
+	queue.Deinit();
+	return result;
+}
+
+static uint64_t SequenceSum(intptr_t n)
+{
+	return (uint64_t)n * (uint64_t)(n - 1) / 2;
+}
+
+static const int QUEUE_THREAD_COUNTS[][2] = { {1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4}, {8, 8} }; // Producers, consumers
+
+void TestQueues()
+{
+	const intptr_t num_values = 1000000;
+	QueueRunResult spsc = RunSPSCQueue(num_values, 64);
+	TEST_CHECK(spsc.OrderErrors == 0);
+	TEST_CHECK(spsc.Sum == SequenceSum(num_values));
+
+	for (int i = 0; i < (int)(sizeof(QUEUE_THREAD_COUNTS) / sizeof(QUEUE_THREAD_COUNTS[0])); i++)
+	{
+		int num_producers = QUEUE_THREAD_COUNTS[i][0];
+		int num_consumers = QUEUE_THREAD_COUNTS[i][1];
+		intptr_t values_per_producer = num_values / num_producers;
+
+		QueueRunResult mpmc = RunMPMCQueue(num_producers, num_consumers, values_per_producer, 64);
+		if (!TEST_CHECK(mpmc.OrderErrors == 0) || !TEST_CHECK(mpmc.Sum == SequenceSum(values_per_producer) * num_producers))
+			printf("  with %d producers and %d consumers\n", num_producers, num_consumers);
+	}
+}
+
+void BenchQueues()
+{
+	const intptr_t num_values = 10000000;
+	printf("%-30s %12s\n", "Queue (capacity 1024)", "M values/s");
+
+	QueueRunResult spsc = RunSPSCQueue(num_values, 1024);
+	printf("%-30s %12.1f\n", "DS_SPSCQueue 1:1", num_values / spsc.Seconds / 1000000.0);
+
+	for (int i = 0; i < (int)(sizeof(QUEUE_THREAD_COUNTS) / sizeof(QUEUE_THREAD_COUNTS[0])); i++)
+	{
+		int num_producers = QUEUE_THREAD_COUNTS[i][0];
+		int num_consumers = QUEUE_THREAD_COUNTS[i][1];
+		intptr_t values_per_producer = num_values / num_producers;
+
+		QueueRunResult mpmc = RunMPMCQueue(num_producers, num_consumers, values_per_producer, 1024);
+		char name[64];
+		snprintf(name, sizeof(name), "DS_MPMCQueue %d:%d", num_producers, num_consumers);
+		printf("%-30s %12.1f\n", name, values_per_producer * num_producers / mpmc.Seconds / 1000000.0);
+	}
+}
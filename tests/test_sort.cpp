@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <algorithm> // std::sort and std::stable_sort, to compare against
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+
+// Sorts inputs of different sizes and shapes with every sort function in ds.h and compares the result with std::stable_sort.
+// The elements remember their original index, so that a result can be checked to be a permutation of the input, and the stable
+// sorts can be checked to keep equal keys in their original order.
+
+struct SortItem
+{
+	uint64_t Key;
+	uint64_t Index;
+};
+
+enum SortPattern
+{
+	SortPattern_Random,
+	SortPattern_Sorted,
+	SortPattern_Reversed,
+	SortPattern_AllEqual,
+	SortPattern_FewDistinct,
+	SortPattern_OrganPipe,
+	SortPattern_COUNT,
+};
+
+static const char* SORT_PATTERN_NAMES[] = { "random", "sorted", "reversed", "all equal", "few distinct", "organ pipe" };
+
+static uint64_t SortPatternKey(SortPattern pattern, intptr_t i, intptr_t n, TestRandom* random)
+{
+	switch (pattern)
+	{
+	case SortPattern_Random:      return random->Next();
+	case SortPattern_Sorted:      return (uint64_t)i;
+	case SortPattern_Reversed:    return (uint64_t)(n - i);
+	case SortPattern_AllEqual:    return 7;
+	case SortPattern_FewDistinct: return random->Next() % 4;
+	case SortPattern_OrganPipe:   return (uint64_t)(i < n / 2 ? i : n - i);
+	case SortPattern_COUNT:       break;
+	}
+	return 0;
+}
+
+typedef void (*SortFn)(DS_Slice<SortItem> items);
+
+struct SortFunction
+{
+	const char* Name;
+	SortFn Sort;
+	bool Stable;
+	uint64_t KeyMask;   // The bits of SortItem::Key that the function sorts by
+	intptr_t MaxSize;   // Larger inputs are skipped, for the quadratic insertion sort
+};
+
+static uint64_t SortItemKey(const SortItem& item) { return item.Key; }
+
+static const SortFunction SORT_FUNCTIONS[] = {
+	{ "DS_Sort", [](DS_Slice<SortItem> items) { DS_Sort(items, SortItemKey); }, false, ~0ull, INTPTR_MAX },
+	{ "DS_InsertionSort", [](DS_Slice<SortItem> items) { auto key = SortItemKey; DS_InsertionSort(items.Data, items.Size, key); }, false, ~0ull, 1000 },
+	{ "DS_HeapSort", [](DS_Slice<SortItem> items) { auto key = SortItemKey; DS_HeapSort(items.Data, items.Size, key); }, false, ~0ull, INTPTR_MAX },
+	{ "DS_RadixSort", [](DS_Slice<SortItem> items) { DS_RadixSort(items, SortItemKey); }, true, ~0ull, INTPTR_MAX },
+	{ "DS_RadixSort 8-bit key", [](DS_Slice<SortItem> items) { DS_RadixSort(items, [](const SortItem& item) { return (uint8_t)item.Key; }); }, true, 0xFF, INTPTR_MAX },
+	{ "DS_ParallelSort 2 threads", [](DS_Slice<SortItem> items) { DS_ParallelSort(items, SortItemKey, 2); }, false, ~0ull, INTPTR_MAX },
+	{ "DS_ParallelSort 8 threads", [](DS_Slice<SortItem> items) { DS_ParallelSort(items, SortItemKey, 8); }, false, ~0ull, INTPTR_MAX },
+};
+
+static bool CheckSorted(const SortFunction& fn, DS_Slice<SortItem> result, DS_Slice<SortItem> expected, DS_Array<bool>* seen)
+{
+	seen->Clear();
+	seen->Resize(result.Size, false);
+	for (intptr_t i = 0; i < result.Size; i++)
+	{
+		if ((result[i].Key & fn.KeyMask) != (expected[i].Key & fn.KeyMask) || result[i].Index >= (uint64_t)result.Size || (*seen)[result[i].Index])
+			return false;
+		if (fn.Stable && result[i].Index != expected[i].Index)
+			return false;
+		(*seen)[result[i].Index] = true;
+	}
+	return true;
+}
+
+void TestSort()
+{
+	// Sizes around the insertion sort threshold, and sizes where DS_ParallelSort splits the elements into 2, 4 and 8 chunks
+	static const intptr_t sizes[] = { 0, 1, 2, 3, 15, 16, 17, 100, 1000, 40000, 80000, 200000 };
+	TestRandom random = { 1 };
+	DS_Array<SortItem> input, expected, result;
+	DS_Array<bool> seen;
+	input.Init();
+	expected.Init();
+	result.Init();
+	seen.Init();
+
+	for (int pattern = 0; pattern < SortPattern_COUNT; pattern++)
+	{
+		for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+		{
+			intptr_t n = sizes[s];
+			input.Clear();
+			for (intptr_t i = 0; i < n; i++)
+				input.Add(SortItem{ SortPatternKey((SortPattern)pattern, i, n, &random), (uint64_t)i });
+
+			for (int f = 0; f < (int)(sizeof(SORT_FUNCTIONS) / sizeof(SORT_FUNCTIONS[0])); f++)
+			{
+				const SortFunction& fn = SORT_FUNCTIONS[f];
+				if (n > fn.MaxSize)
+					continue;
+
+				expected.Clear();
+				expected.AddSlice(input);
+				std::stable_sort(expected.Data, expected.Data + n, [&](const SortItem& a, const SortItem& b) {
+					return (a.Key & fn.KeyMask) < (b.Key & fn.KeyMask);
+				});
+
+				result.Clear();
+				result.AddSlice(input);
+				fn.Sort(result);
+				if (!TEST_CHECK(CheckSorted(fn, result, expected, &seen)))
+					printf("  %s, %s input of %lld elements\n", fn.Name, SORT_PATTERN_NAMES[pattern], (long long)n);
+			}
+		}
+	}
+
+	input.Deinit();
+	expected.Deinit();
+	result.Deinit();
+	seen.Deinit();
+}
+
+static uint64_t IdentityKey(const uint64_t& x) { return x; }
+
+void BenchSort()
+{
+	const intptr_t n = 10000000;
+	int num_threads = OS_GetProcessorCount();
+
+	// The sorted result of the random and the sorted input, from std::sort
+	DS_Array<uint64_t> input, data, expected[2];
+	input.Init(NULL, n);
+	data.Init(NULL, n);
+	expected[0].Init(NULL, n);
+	expected[1].Init(NULL, n);
+
+	printf("%-30s %12s %12s\n", "Sort 10M uint64_t", "random (ms)", "sorted (ms)");
+	for (int f = 0; f < 4; f++)
+	{
+		const char* name = "";
+		double ms[2];
+		for (int sorted = 0; sorted < 2; sorted++)
+		{
+			TestRandom random = { 2 };
+			input.Clear();
+			for (intptr_t i = 0; i < n; i++)
+				input.Add(sorted ? (uint64_t)i : random.Next());
+			data.Clear();
+			data.AddSlice(input);
+
+			uint64_t start_time = OS_GetTimeMicroseconds();
+			switch (f)
+			{
+			case 0: name = "std::sort"; std::sort(data.Data, data.Data + n); break;
+			case 1: name = "DS_Sort"; DS_Sort(DS_Slice<uint64_t>(data), IdentityKey); break;
+			case 2: name = "DS_RadixSort"; DS_RadixSort(DS_Slice<uint64_t>(data), IdentityKey); break;
+			case 3: name = "DS_ParallelSort"; DS_ParallelSort(DS_Slice<uint64_t>(data), IdentityKey, num_threads); break;
+			}
+			ms[sorted] = (OS_GetTimeMicroseconds() - start_time) / 1000.0;
+
+			// Every sort must produce the same result as std::sort
+			if (f == 0)
+				expected[sorted].AddSlice(data);
+			else
+				TEST_CHECK(memcmp(data.Data, expected[sorted].Data, n * sizeof(uint64_t)) == 0);
+		}
+
+		char label[64];
+		if (f == 3)
+			snprintf(label, sizeof(label), "%s (%d threads)", name, num_threads);
+		else
+			snprintf(label, sizeof(label), "%s", name);
+		printf("%-30s %12.1f %12.1f\n", label, ms[0], ms[1]);
+	}
+
+	input.Deinit();
+	data.Deinit();
+	expected[0].Deinit();
+	expected[1].Deinit();
+}
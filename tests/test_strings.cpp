@@ -0,0 +1,122 @@
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "tests.h"
+
+// Tests the string utilities of ds.h.
+
+// DS_HashString is evaluated at compile time here, and must give the same hashes as DS_Hash64 at runtime, since the parser
+// switches on hashed file extensions. The expected value is checked at compile time too, so a change of the hash function
+// that only one of them follows fails to compile or fails the test.
+static_assert(DS_HashString("cmake") == 0x6FD28685DEFA1BEFull, "DS_HashString changed");
+
+struct HashStringCase
+{
+	DS_StringView Str;
+	uint64_t Hash;       // DS_HashString(Str), evaluated at compile time
+	uint64_t SeededHash; // DS_HashString(Str, 7), evaluated at compile time
+};
+
+#define HASH_STRING_CASE(STR) { STR, DS_HashString(STR), DS_HashString(STR, 7) }
+
+// Every length up to two words, so that every size of the tail is hashed
+static constexpr HashStringCase HASH_STRING_CASES[] = {
+	HASH_STRING_CASE(""),
+	HASH_STRING_CASE("a"),
+	HASH_STRING_CASE("py"),
+	HASH_STRING_CASE("lua"),
+	HASH_STRING_CASE("cmake"),
+	HASH_STRING_CASE("\xFF\x80\x01\x00\x7F"), // Bytes with the top bit set must not be sign-extended
+	HASH_STRING_CASE("abcdef"),
+	HASH_STRING_CASE("abcdefg"),
+	HASH_STRING_CASE("abcdefgh"),
+	HASH_STRING_CASE("abcdefghi"),
+	HASH_STRING_CASE("abcdefghijklmno"),
+	HASH_STRING_CASE("abcdefghijklmnop"),
+	HASH_STRING_CASE("abcdefghijklmnopq"),
+};
+
+static void TestHashString()
+{
+	TEST_CHECK(DS_Hash64("cmake", 5) == 0x6FD28685DEFA1BEFull);
+
+	for (int i = 0; i < (int)(sizeof(HASH_STRING_CASES) / sizeof(HASH_STRING_CASES[0])); i++)
+	{
+		const HashStringCase& c = HASH_STRING_CASES[i];
+		bool ok = c.Hash == DS_Hash64(c.Str.Data, (size_t)c.Str.Size) && c.SeededHash == DS_Hash64(c.Str.Data, (size_t)c.Str.Size, 7);
+		ok = ok && c.Hash == DS_HashString(c.Str); // At runtime, DS_HashString calls DS_Hash64
+		if (!TEST_CHECK(ok))
+			printf("  DS_HashString of %lld bytes\n", (long long)c.Str.Size);
+	}
+}
+
+template<int CAPACITY>
+static bool InlineStringIs(const DS_InlineString<CAPACITY>& str, DS_StringView expected)
+{
+	return str.Size == expected.Size && memcmp(str.Data, expected.Data, expected.Size) == 0 && str.Data[str.Size] == 0 &&
+		DS_Str(str.CStr()).Size == expected.Size;
+}
+
+// Fills the string up to exactly CAPACITY-1 and CAPACITY bytes with Add and Addf, and checks that adding more fails without
+// changing the string, including when Addf has already written the part that fits.
+template<int CAPACITY>
+static void CheckInlineStringCapacity()
+{
+	DS_Array<char> chars;
+	chars.Init();
+	chars.Resize(CAPACITY + 1, 'a');
+	chars[CAPACITY - 1] = 'b';
+	chars[CAPACITY] = 'c';
+	DS_StringView almost_full(chars.Data, CAPACITY - 1), full(chars.Data, CAPACITY), too_long(chars.Data, CAPACITY + 1);
+
+	bool ok = true;
+	for (int use_addf = 0; use_addf < 2; use_addf++)
+	{
+		auto add = [&](DS_InlineString<CAPACITY>* str, DS_StringView s) {
+			return use_addf ? str->Addf("%.*s", (int)s.Size, s.Data) : str->Add(s);
+		};
+
+		DS_InlineString<CAPACITY> str;
+		ok = ok && TEST_CHECK(add(&str, almost_full) && InlineStringIs(str, almost_full));
+		ok = ok && TEST_CHECK(add(&str, "b") && InlineStringIs(str, full));
+		ok = ok && TEST_CHECK(!add(&str, "c") && InlineStringIs(str, full));
+		ok = ok && TEST_CHECK(add(&str, "") && InlineStringIs(str, full));
+
+		str.Clear();
+		ok = ok && TEST_CHECK(add(&str, full) && InlineStringIs(str, full));
+
+		str.Clear();
+		ok = ok && TEST_CHECK(!add(&str, too_long) && InlineStringIs(str, ""));
+
+		// Only part of the added text fits
+		str.Clear();
+		ok = ok && TEST_CHECK(add(&str, almost_full.Slice(0, CAPACITY - 2)) && !add(&str, "bcd") && InlineStringIs(str, almost_full.Slice(0, CAPACITY - 2)));
+
+		if (!ok)
+		{
+			printf("  %s with a capacity of %d\n", use_addf ? "Addf" : "Add", CAPACITY);
+			break;
+		}
+	}
+
+	// Formatting that fits exactly
+	DS_InlineString<CAPACITY> number;
+	TEST_CHECK(number.Addf("%0*d", CAPACITY, 7) && number.Size == CAPACITY && number.Data[CAPACITY - 1] == '7');
+	chars.Deinit();
+}
+
+// The capacities around the switch from a 1-byte to a 4-byte Size
+static void TestInlineString()
+{
+	CheckInlineStringCapacity<2>();
+	CheckInlineStringCapacity<16>();
+	CheckInlineStringCapacity<255>();
+	CheckInlineStringCapacity<256>();
+}
+
+void TestStrings()
+{
+	TestHashString();
+	TestInlineString();
+}
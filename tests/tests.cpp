@@ -0,0 +1,100 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+
+#include "src/ds/ds.h"
+
+#include "src/win32_utils.h"
+#include "tests.h"
+#include <Windows.h>
+
+struct Test
+{
+	const char* Name;
+	void (*Run)();
+	void (*Bench)(); // NULL if the test has no benchmark
+	bool NamedOnly;  // Only run when the test is named on the command line, for tests that need a lot of time, memory or disk space
+};
+
+static const Test TESTS[] = {
+	{ "bit_set", TestBitSet, NULL, false },
+	{ "block_parser", TestBlockParser, NULL, false },
+	{ "concurrent_map", TestConcurrentMap, BenchConcurrentMap, false },
+	{ "image", TestImage, NULL, false },
+	{ "large_files", TestLargeFiles, NULL, true },
+	{ "line_index", TestLineIndex, NULL, false },
+	{ "map", TestMap, BenchMap, false },
+	{ "named_blocks", TestNamedBlocks, NULL, false },
+	{ "queues", TestQueues, BenchQueues, false },
+	{ "sort", TestSort, BenchSort, false },
+	{ "strings", TestStrings, NULL, false },
+};
+
+static int NumFailedChecks = 0;
+
+bool TestCheck(bool ok, const char* condition, const char* file, int line)
+{
+	if (!ok)
+	{
+		printf("%s(%d): check failed: %s\n", file, line, condition);
+		NumFailedChecks += 1;
+	}
+	return ok;
+}
+
+static void PrintOutput(OS_RunProcessPrintCallback* self, const char* message)
+{
+	printf("%s", message);
+}
+
+bool RunPyExpand(const char* arguments)
+{
+	char exe_path[MAX_PATH];
+	DWORD exe_path_size = GetModuleFileNameA(NULL, exe_path, MAX_PATH);
+	DS_StringView exe_directory = DS_StringView(exe_path, exe_path_size);
+	exe_directory = exe_directory.Slice(0, exe_directory.RFindChar('\\'));
+
+	DS_ScopedArena<1024> temp;
+	DS_DynamicString command(&temp);
+	command.Addf("\"%.*s\\PyExpand.exe\" %s", DS_StrVArg(exe_directory), arguments);
+	uint32_t exit_code = 1;
+	OS_RunProcessPrintCallback print = { PrintOutput };
+	return OS_RunConsoleCommand(command, true, &exit_code, &print) && exit_code == 0;
+}
+
+// Usage:
+// PyExpandTests [--bench] [test names ...]
+int main(int argc, const char** argv)
+{
+	bool run_benchmarks = false;
+	int first_name = 1;
+	if (argc > 1 && DS_Str(argv[1]) == "--bench")
+	{
+		run_benchmarks = true;
+		first_name = 2;
+	}
+
+	for (int i = 0; i < (int)(sizeof(TESTS) / sizeof(TESTS[0])); i++)
+	{
+		const Test& test = TESTS[i];
+		bool selected = first_name == argc && !test.NamedOnly;
+		for (int j = first_name; j < argc; j++)
+			selected = selected || DS_Str(argv[j]) == test.Name;
+		if (!selected)
+			continue;
+
+		printf("-- %s\n", test.Name);
+		uint64_t start_time = OS_GetTimeMicroseconds();
+		test.Run();
+		if (run_benchmarks && test.Bench)
+			test.Bench();
+		printf("-- %s: %.1f s\n", test.Name, (OS_GetTimeMicroseconds() - start_time) / 1000000.0);
+	}
+
+	if (NumFailedChecks > 0)
+	{
+		printf("%d checks failed!\n", NumFailedChecks);
+		return 1;
+	}
+	printf("All checks passed.\n");
+	return 0;
+}
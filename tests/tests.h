@@ -0,0 +1,67 @@
+
+// Tests and benchmarks for PyExpand and ds.h, built as the PyExpandTests project.
+//
+// `PyExpandTests` runs all tests, and `PyExpandTests --bench` runs the benchmarks too. Names of tests can be given to only run those,
+// e.g. `PyExpandTests --bench sort`. Tests that need a lot of resources, like `large_files`, only run when they are named. The process
+// exits with 1 if any check failed.
+
+// Prints the failed condition with its location and counts the failure. Returns `ok`, so that a test can stop early.
+#define TEST_CHECK(condition) TestCheck((condition), #condition, __FILE__, __LINE__)
+
+bool TestCheck(bool ok, const char* condition, const char* file, int line);
+
+// Runs PyExpand.exe, which must be next to the test executable, with `arguments`, e.g. the paths of files to expand, and prints its
+// output. Returns false if it couldn't be started or exited with an error.
+bool RunPyExpand(const char* arguments);
+
+// Deterministic pseudo-random numbers, so that failures can be reproduced
+struct TestRandom
+{
+	uint64_t State;
+
+	inline uint64_t Next()
+	{
+		// splitmix64
+		uint64_t z = (State += 0x9E3779B97F4A7C15);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+		return z ^ (z >> 31);
+	}
+};
+
+// test_bit_set.cpp
+void TestBitSet();
+
+// test_block_parser.cpp
+void TestBlockParser();
+
+// test_concurrent_map.cpp
+void TestConcurrentMap();
+void BenchConcurrentMap();
+
+// test_image.cpp
+void TestImage();
+
+// test_large_files.cpp
+void TestLargeFiles();
+
+// test_line_index.cpp
+void TestLineIndex();
+
+// test_map.cpp
+void TestMap();
+void BenchMap();
+
+// test_named_blocks.cpp
+void TestNamedBlocks();
+
+// test_queues.cpp
+void TestQueues();
+void BenchQueues();
+
+// test_sort.cpp
+void TestSort();
+void BenchSort();
+
+// test_strings.cpp
+void TestStrings();